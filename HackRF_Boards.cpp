@@ -0,0 +1,117 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <SoapySDR/Logger.hpp>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * libhackrf runs a transfer thread per open board and gives no way to
+ * drive several boards from one libusb event loop, so with many duplex
+ * pairs in a process the manager keeps those threads in check instead:
+ * given a CPU list, each transfer thread is pinned to the next CPU in
+ * turn the first time it calls back, keeping them off the cores the
+ * application's DSP runs on. Changing the list re-places every thread on
+ * its next callback.
+ *
+ * The claimed serial registry is shared by all instances and enumeration,
+ * which may run on any thread, so it is only touched under the mutex.
+ */
+
+static std::string HackRF_normalSerial(const std::string &serial) {
+  const size_t first = serial.find_first_not_of('0');
+  return first == std::string::npos ? std::string() : serial.substr(first);
+}
+
+HackRF_BoardManager::HackRF_BoardManager(void)
+    : _next_cpu(0), _generation(0) {}
+
+HackRF_BoardManager &HackRF_BoardManager::instance(void) {
+  static HackRF_BoardManager manager;
+  return manager;
+}
+
+bool HackRF_BoardManager::claim(const std::string &serial) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _claimed.insert(HackRF_normalSerial(serial)).second;
+}
+
+void HackRF_BoardManager::release(const std::string &serial) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _claimed.erase(HackRF_normalSerial(serial));
+}
+
+bool HackRF_BoardManager::claimed(const std::string &serial) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _claimed.count(HackRF_normalSerial(serial)) != 0;
+}
+
+std::set<std::string> HackRF_BoardManager::claimed_serials(void) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _claimed;
+}
+
+void HackRF_BoardManager::set_callback_cpus(const std::vector<int> &cpus) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _cpus = cpus;
+  _next_cpu = 0;
+  _generation++;
+}
+
+std::vector<int> HackRF_BoardManager::callback_cpus(void) const {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _cpus;
+}
+
+void HackRF_BoardManager::place_callback_thread(void) {
+  // the generation this thread was last placed for
+  static thread_local unsigned placed = 0;
+  const unsigned generation = _generation.load(std::memory_order_relaxed);
+  if (placed == generation) return;
+  placed = generation;
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  // an emptied list lets threads placed before run anywhere again
+  const int cpu = _cpus.empty() ? -1 : _cpus[_next_cpu++ % _cpus.size()];
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpu < 0) {
+    for (int i = 0; i < CPU_SETSIZE; ++i) CPU_SET(i, &set);
+  } else {
+    CPU_SET(cpu, &set);
+  }
+  const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (ret != 0) {
+    SoapySDR_logf(SOAPY_SDR_WARNING, "Could not pin transfer thread to CPU %d",
+                  cpu);
+  }
+#else
+  if (cpu >= 0) {
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "Transfer thread pinning not supported");
+  }
+#endif
+}
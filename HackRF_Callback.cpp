@@ -0,0 +1,237 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * Push model streaming. A registered callback is driven from a worker
+ * thread owned by the driver for as long as its stream is active. CS8
+ * streams without the channelizer or DUC hand the callback the transfer
+ * buffer itself, so a buffer is neither copied nor passed between threads
+ * on its way to the application. Other formats are converted once into a
+ * buffer owned by the worker, exactly as readStream() and writeStream()
+ * would do.
+ */
+
+static size_t format_size(uint32_t format) {
+  switch (format) {
+    case HACKRF_FORMAT_FLOAT64:
+      return 2 * sizeof(double);
+    case HACKRF_FORMAT_FLOAT32:
+      return 2 * sizeof(float);
+    case HACKRF_FORMAT_INT16:
+    case HACKRF_FORMAT_FLOAT16:
+      return 2 * sizeof(int16_t);
+    default:
+      return 2 * sizeof(int8_t);
+  }
+}
+
+int SoapyHackRFDuplex::set_stream_callback(const int direction,
+                                           const std::string &value) {
+  unsigned long long fn_in = 0, user_in = 0;
+  if (not value.empty() and
+      sscanf(value.c_str(), "%llx:%llx", &fn_in, &user_in) != 2) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "stream callback %s invalid",
+                  value.c_str());
+    return SOAPY_SDR_NOT_SUPPORTED;
+  }
+
+  SoapySDR::Stream *stream = direction == SOAPY_SDR_RX ? RX_STREAM : TX_STREAM;
+  StreamWorker &worker = direction == SOAPY_SDR_RX ? _rx_worker : _tx_worker;
+  this->stop_stream_worker(stream);
+
+  std::lock_guard<std::mutex> lock(direction == SOAPY_SDR_RX
+                                       ? _rx_device_mutex
+                                       : _tx_device_mutex);
+  {
+    std::lock_guard<std::mutex> worker_lock(_worker_mutex);
+    worker.user = reinterpret_cast<void *>((uintptr_t)user_in);
+    if (direction == SOAPY_SDR_RX) {
+      worker.rx_fn =
+          reinterpret_cast<SoapyHackRFDuplexRXCallback>((uintptr_t)fn_in);
+    } else {
+      worker.tx_fn =
+          reinterpret_cast<SoapyHackRFDuplexTXCallback>((uintptr_t)fn_in);
+    }
+  }
+
+  // registering on a running stream takes over from the next buffer
+  const bool active =
+      direction == SOAPY_SDR_RX
+          ? _rx_active == HACKRF_TRANSCEIVER_MODE_ON
+          : (_tx_active == HACKRF_TRANSCEIVER_MODE_ON or
+             _tx_stream.start_pending);
+  if (active) this->start_stream_worker(stream);
+  return 0;
+}
+
+void SoapyHackRFDuplex::start_stream_worker(SoapySDR::Stream *stream) {
+  std::lock_guard<std::mutex> lock(_worker_mutex);
+  StreamWorker &worker = stream == RX_STREAM ? _rx_worker : _tx_worker;
+  if (stream == RX_STREAM ? worker.rx_fn == nullptr
+                          : worker.tx_fn == nullptr) {
+    return;
+  }
+
+  if (worker.thread.joinable()) {
+    // still running, or a worker that stopped itself from its callback
+    if (worker.thread_generation == worker.generation or
+        worker.thread.get_id() == std::this_thread::get_id()) {
+      return;
+    }
+    worker.thread.join();
+  }
+
+  worker.thread_generation = ++worker.generation;
+  if (stream == RX_STREAM) {
+    worker.thread = std::thread(&SoapyHackRFDuplex::rx_worker_loop, this,
+                                worker.thread_generation);
+  } else {
+    worker.thread = std::thread(&SoapyHackRFDuplex::tx_worker_loop, this,
+                                worker.thread_generation);
+  }
+}
+
+void SoapyHackRFDuplex::stop_stream_worker(SoapySDR::Stream *stream) {
+  StreamWorker &worker = stream == RX_STREAM ? _rx_worker : _tx_worker;
+  std::thread thread;
+  {
+    std::lock_guard<std::mutex> lock(_worker_mutex);
+    ++worker.generation;
+    // called from the callback, the worker ends once the callback returns
+    if (worker.thread.get_id() == std::this_thread::get_id()) return;
+    thread.swap(worker.thread);
+  }
+  if (thread.joinable()) thread.join();
+}
+
+void SoapyHackRFDuplex::rx_worker_loop(const unsigned generation) {
+  StreamWorker &worker = _rx_worker;
+
+  while (worker.generation == generation) {
+    int flags = 0;
+    long long timeNs = 0;
+
+    const bool dsp = this->sync_rx_path();
+    if (_rx_stream.format == HACKRF_FORMAT_INT8 and not dsp and
+        _rx_stream.dsp_offset == _rx_stream.dsp_samps and
+        _rx_stream.remainderHandle < 0) {
+      size_t handle = 0;
+      const void *buff = nullptr;
+      int ret = this->acquireReadBuffer(RX_STREAM, handle, &buff, flags,
+                                        timeNs, HACKRF_WORKER_TIMEOUT_US);
+      if (ret == SOAPY_SDR_TIMEOUT) continue;
+      worker.rx_fn(worker.user, &buff, ret, flags, timeNs);
+      if (ret >= 0) {
+        this->releaseReadBuffer(RX_STREAM, handle);
+      } else if (ret != SOAPY_SDR_OVERFLOW) {
+        break;
+      }
+      continue;
+    }
+
+    size_t num_channels;
+    {
+      std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+      num_channels = std::max<size_t>(1, _rx_stream.stream_channels.size());
+    }
+    const size_t mtu = this->getStreamMTU(RX_STREAM);
+    worker.bufs.resize(num_channels);
+    worker.buffs.resize(num_channels);
+    for (size_t i = 0; i < num_channels; ++i) {
+      worker.bufs[i].resize(mtu * format_size(_rx_stream.format));
+      worker.buffs[i] = worker.bufs[i].data();
+    }
+
+    int ret = this->readStream(RX_STREAM, worker.buffs.data(), mtu, flags,
+                               timeNs, HACKRF_WORKER_TIMEOUT_US);
+    if (ret == SOAPY_SDR_TIMEOUT) continue;
+    worker.rx_fn(worker.user, worker.buffs.data(), ret, flags, timeNs);
+    if (ret < 0 and ret != SOAPY_SDR_OVERFLOW) break;
+  }
+}
+
+void SoapyHackRFDuplex::tx_worker_loop(const unsigned generation) {
+  StreamWorker &worker = _tx_worker;
+
+  while (worker.generation == generation) {
+    int flags = 0;
+
+    const bool dsp = this->sync_tx_path();
+    if (_tx_stream.format == HACKRF_FORMAT_INT8 and not dsp and
+        not _tx_stream.cyclic and _tx_stream.remainderHandle < 0) {
+      size_t handle = 0;
+      void *buff = nullptr;
+      int ret = this->acquireWriteBuffer(TX_STREAM, handle, &buff,
+                                         HACKRF_WORKER_TIMEOUT_US);
+      if (ret == SOAPY_SDR_TIMEOUT) continue;
+      if (ret < 0) break;
+
+      const int n = worker.tx_fn(worker.user, &buff, ret, flags);
+      // an acquired buffer cannot be handed back, a stopping callback ends
+      // the burst with it instead
+      if (n < 0) flags |= SOAPY_SDR_END_BURST;
+      int used = std::min(std::max(n, 0), ret);
+      if ((flags & SOAPY_SDR_END_BURST) == 0 and used < ret) {
+        // keep the board fed, short buffers otherwise run on into the next
+        memset((int8_t *)buff + used * BYTES_PER_SAMPLE, 0,
+               (ret - used) * BYTES_PER_SAMPLE);
+        used = ret;
+      }
+      this->releaseWriteBuffer(TX_STREAM, handle, used, flags);
+      if (n < 0) break;
+      continue;
+    }
+
+    const size_t mtu = this->getStreamMTU(TX_STREAM);
+    const size_t elem_size = format_size(_tx_stream.format);
+    worker.bufs.resize(1);
+    worker.buffs.resize(1);
+    worker.bufs[0].resize(mtu * elem_size);
+    worker.buffs[0] = worker.bufs[0].data();
+
+    int n = worker.tx_fn(worker.user, worker.buffs.data(), mtu, flags);
+    if (n < 0) break;
+    n = std::min<int>(n, mtu);
+    if ((flags & SOAPY_SDR_END_BURST) == 0) {
+      // keep the board fed, as a short raw buffer would be
+      memset(worker.bufs[0].data() + n * elem_size, 0,
+             (mtu - n) * elem_size);
+      n = mtu;
+    }
+
+    int written = 0;
+    while (written < n and worker.generation == generation) {
+      const void *buff = worker.bufs[0].data() + written * elem_size;
+      int ret = this->writeStream(TX_STREAM, &buff, n - written, flags, 0,
+                                  HACKRF_WORKER_TIMEOUT_US);
+      if (ret == SOAPY_SDR_TIMEOUT) continue;
+      if (ret < 0) return;
+      written += ret;
+    }
+  }
+}
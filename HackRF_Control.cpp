@@ -0,0 +1,149 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * Asynchronous control plane. With async_control on, the setters that
+ * talk to a board over USB queue the write for that board's control
+ * worker and return at once; the worker applies it through the same
+ * setter, so the USB transfer and the device mutex stay off the caller's
+ * thread. A write to a key that is still queued replaces the queued one
+ * and moves to the back, so a burst of slider moves costs one transfer
+ * and the last write still lands last.
+ *
+ * Every write gets a sequence number, readable as control_issued straight
+ * after the call. control_completed is the highest number up to which all
+ * writes have been applied, and control_wait blocks until a given number
+ * (or everything issued so far) has been.
+ */
+
+bool SoapyHackRFDuplex::defer_control(const int direction,
+                                      const std::string &key,
+                                      const std::function<void(void)> &apply) {
+  ControlQueue &q = direction == SOAPY_SDR_RX ? _rx_control : _tx_control;
+  std::lock_guard<std::mutex> lock(q.mutex);
+  if (not q.enabled or std::this_thread::get_id() == q.thread.get_id()) {
+    return false;
+  }
+
+  const uint64_t seq = ++_control_issued;
+  uint64_t first_seq = seq;
+  for (auto it = q.writes.begin(); it != q.writes.end(); ++it) {
+    if (it->key == key) {
+      first_seq = it->first_seq;
+      q.writes.erase(it);
+      break;
+    }
+  }
+  ControlQueue::Write write;
+  write.key = key;
+  write.apply = apply;
+  write.first_seq = first_seq;
+  q.writes.push_back(write);
+  q.cond.notify_all();
+  return true;
+}
+
+void SoapyHackRFDuplex::start_control(void) {
+  const int directions[] = {SOAPY_SDR_RX, SOAPY_SDR_TX};
+  for (const int direction : directions) {
+    ControlQueue &q = direction == SOAPY_SDR_RX ? _rx_control : _tx_control;
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.enabled) continue;
+    q.enabled = true;
+    q.quit = false;
+    q.thread = std::thread(&SoapyHackRFDuplex::control_worker, this, direction);
+  }
+}
+
+void SoapyHackRFDuplex::stop_control(void) {
+  const int directions[] = {SOAPY_SDR_RX, SOAPY_SDR_TX};
+  for (const int direction : directions) {
+    ControlQueue &q = direction == SOAPY_SDR_RX ? _rx_control : _tx_control;
+    {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      if (not q.enabled) continue;
+      // new writes apply synchronously, the worker drains what is queued
+      q.enabled = false;
+      q.quit = true;
+      q.cond.notify_all();
+    }
+    q.thread.join();
+  }
+}
+
+void SoapyHackRFDuplex::control_worker(const int direction) {
+  ControlQueue &q = direction == SOAPY_SDR_RX ? _rx_control : _tx_control;
+  std::unique_lock<std::mutex> lock(q.mutex);
+  while (true) {
+    q.cond.wait(lock, [&q] { return q.quit or not q.writes.empty(); });
+    if (q.writes.empty()) break;
+
+    ControlQueue::Write write = q.writes.front();
+    q.writes.pop_front();
+    q.running = write.first_seq;
+    lock.unlock();
+    try {
+      write.apply();
+    } catch (const std::exception &e) {
+      _control_errors++;
+      SoapySDR_logf(SOAPY_SDR_ERROR, "control write %s failed: %s",
+                    write.key.c_str(), e.what());
+    }
+    lock.lock();
+    q.running = 0;
+    q.cond.notify_all();
+  }
+}
+
+void SoapyHackRFDuplex::wait_control(const uint64_t seq) {
+  // writes only ever join a queue with a higher number than any issued
+  // before, so each queue can be waited on in turn
+  ControlQueue *queues[] = {&_rx_control, &_tx_control};
+  for (ControlQueue *q : queues) {
+    std::unique_lock<std::mutex> lock(q->mutex);
+    q->cond.wait(lock, [q, seq] {
+      if (q->running != 0 and q->running <= seq) return false;
+      for (size_t i = 0; i < q->writes.size(); ++i) {
+        if (q->writes[i].first_seq <= seq) return false;
+      }
+      return true;
+    });
+  }
+}
+
+uint64_t SoapyHackRFDuplex::control_completed(void) const {
+  std::lock_guard<std::mutex> rx_lock(_rx_control.mutex);
+  std::lock_guard<std::mutex> tx_lock(_tx_control.mutex);
+  uint64_t completed = _control_issued;
+  const ControlQueue *queues[] = {&_rx_control, &_tx_control};
+  for (const ControlQueue *q : queues) {
+    if (q->running != 0) completed = std::min(completed, q->running - 1);
+    for (size_t i = 0; i < q->writes.size(); ++i) {
+      completed = std::min(completed, q->writes[i].first_seq - 1);
+    }
+  }
+  return completed;
+}
@@ -0,0 +1,861 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "HackRF_DSP.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+#include <immintrin.h>
+#define HACKRF_DSP_F16C_DISPATCH
+#define HACKRF_DSP_AVX_DISPATCH
+#endif
+
+void HackRF_cs8_to_cf32(const int8_t *src, float *dst, size_t n) {
+  const float scale = 1.0f / 127.0f;
+  for (size_t i = 0; i < n * 2; ++i) {
+    dst[i] = src[i] * scale;
+  }
+}
+
+void HackRF_cf32_to_cs8(const float *src, int8_t *dst, size_t n) {
+  for (size_t i = 0; i < n * 2; ++i) {
+    float v = src[i] * 127.0f;
+    v = v > 127.0f ? 127.0f : (v < -128.0f ? -128.0f : v);
+    dst[i] = (int8_t)lrintf(v);
+  }
+}
+
+/*******************************************************************
+ * Half precision
+ ******************************************************************/
+
+static uint16_t f32_to_f16_scalar(float value) {
+  uint32_t x;
+  memcpy(&x, &value, sizeof(x));
+
+  const uint32_t sign = (x >> 16) & 0x8000;
+  const int32_t exp = ((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+
+  if (((x >> 23) & 0xff) == 0xff) {
+    // inf or nan
+    return sign | 0x7c00 | (mant ? 0x200 : 0);
+  }
+  if (exp >= 31) return sign | 0x7c00;
+  if (exp <= 0) {
+    // subnormal or zero
+    if (exp < -10) return sign;
+    mant |= 0x800000;
+    const uint32_t shift = 14 - exp;
+    uint32_t half = mant >> shift;
+    const uint32_t rem = mant & ((1u << shift) - 1);
+    const uint32_t mid = 1u << (shift - 1);
+    if (rem > mid or (rem == mid and (half & 1))) half++;
+    return sign | half;
+  }
+
+  uint32_t half = (exp << 10) | (mant >> 13);
+  const uint32_t rem = mant & 0x1fff;
+  if (rem > 0x1000 or (rem == 0x1000 and (half & 1))) half++;
+  return sign | half;
+}
+
+static float f16_to_f32_scalar(uint16_t h) {
+  const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+
+  if (exp == 0) {
+    if (mant == 0) {
+      x = sign;
+    } else {
+      // normalise the subnormal
+      exp = 127 - 15 + 1;
+      while ((mant & 0x400) == 0) {
+        mant <<= 1;
+        exp--;
+      }
+      x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  } else if (exp == 31) {
+    x = sign | 0x7f800000 | (mant << 13);
+  } else {
+    x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+  }
+
+  float value;
+  memcpy(&value, &x, sizeof(value));
+  return value;
+}
+
+#ifdef HACKRF_DSP_F16C_DISPATCH
+static bool have_f16c(void) {
+  static const bool ok =
+      __builtin_cpu_supports("avx") and __builtin_cpu_supports("f16c");
+  return ok;
+}
+
+__attribute__((target("avx,f16c"))) static size_t f32_to_f16_f16c(
+    const float *src, uint16_t *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256 v = _mm256_loadu_ps(src + i);
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  return i;
+}
+
+__attribute__((target("avx,f16c"))) static size_t f16_to_f32_f16c(
+    const uint16_t *src, float *dst, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i h = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  return i;
+}
+#endif
+
+void HackRF_f32_to_f16(const float *src, uint16_t *dst, size_t count) {
+  size_t i = 0;
+#ifdef HACKRF_DSP_F16C_DISPATCH
+  if (have_f16c()) i = f32_to_f16_f16c(src, dst, count);
+#endif
+  for (; i < count; ++i) dst[i] = f32_to_f16_scalar(src[i]);
+}
+
+void HackRF_f16_to_f32(const uint16_t *src, float *dst, size_t count) {
+  size_t i = 0;
+#ifdef HACKRF_DSP_F16C_DISPATCH
+  if (have_f16c()) i = f16_to_f32_f16c(src, dst, count);
+#endif
+  for (; i < count; ++i) dst[i] = f16_to_f32_scalar(src[i]);
+}
+
+void HackRF_cs8_to_cf16(const int8_t *src, uint16_t *dst, size_t n,
+                        float scale) {
+  // widen through a small block that stays in L1
+  float block[HACKRF_DSP_NCO_BLOCK * 2];
+  while (n > 0) {
+    const size_t len = std::min<size_t>(n, HACKRF_DSP_NCO_BLOCK);
+    for (size_t i = 0; i < len * 2; ++i) {
+      block[i] = src[i] * scale;
+    }
+    HackRF_f32_to_f16(block, dst, len * 2);
+    src += len * 2;
+    dst += len * 2;
+    n -= len;
+  }
+}
+
+float HackRF_cs8_power(const int8_t *src, size_t n) {
+  // 32-bit sums over blocks short enough not to overflow, which keeps the
+  // inner loop a plain multiply-add the compiler can vectorize
+  const size_t block = 8192;
+  const size_t count = n * 2;
+  uint64_t total = 0;
+  for (size_t i = 0; i < count; i += block) {
+    const size_t end = std::min(count, i + block);
+    int32_t acc = 0;
+    for (size_t j = i; j < end; ++j) {
+      acc += (int32_t)src[j] * src[j];
+    }
+    total += acc;
+  }
+  return n > 0 ? (float)(total / (n * 127.0 * 127.0)) : 0.0f;
+}
+
+std::vector<float> HackRF_design_lowpass(size_t ntaps, double cutoff,
+                                         double gain) {
+  std::vector<float> taps(ntaps);
+  const double mid = (ntaps - 1) / 2.0;
+  double sum = 0.0;
+
+  for (size_t i = 0; i < ntaps; ++i) {
+    const double x = i - mid;
+    const double sinc =
+        (x == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+    const double w =
+        (ntaps == 1) ? 1.0
+                     : 0.42 - 0.5 * cos(2.0 * M_PI * i / (ntaps - 1)) +
+                           0.08 * cos(4.0 * M_PI * i / (ntaps - 1));
+    taps[i] = sinc * w;
+    sum += taps[i];
+  }
+
+  // normalise for the requested DC gain
+  for (size_t i = 0; i < ntaps; ++i) {
+    taps[i] = taps[i] * gain / sum;
+  }
+  return taps;
+}
+
+double HackRF_plan_board_rate(double rate, double min_rate, double max_rate,
+                              size_t &factor) {
+  factor = 1;
+  if (rate <= 0.0) return rate;
+
+  const size_t first = std::max<size_t>(1, (size_t)ceil(min_rate / rate));
+  if (rate * first > max_rate) return rate;
+
+  for (size_t f = first; rate * f <= max_rate; ++f) {
+    const double board = rate * f;
+    if (fabs(board - llround(board)) < 1e-6) {
+      factor = f;
+      return llround(board);
+    }
+  }
+
+  factor = first;
+  return ceil(rate * first);
+}
+
+/*******************************************************************
+ * FIR kernel
+ ******************************************************************/
+
+/*
+ * Filters keep their taps duplicated (t0, t0, t1, t1, ...) so a window of
+ * interleaved samples and its taps are both read with unit stride; the even
+ * lanes of every partial sum accumulate I and the odd lanes Q. The partial
+ * sums are independent, so the adds need no reassociation to vectorize.
+ */
+static std::vector<float> duplicate_taps(const float *taps, size_t n) {
+  std::vector<float> pairs(n * 2);
+  for (size_t k = 0; k < n; ++k) {
+    pairs[k * 2] = taps[k];
+    pairs[k * 2 + 1] = taps[k];
+  }
+  return pairs;
+}
+
+#ifdef HACKRF_DSP_AVX_DISPATCH
+static bool have_avx(void) {
+  static const bool ok = __builtin_cpu_supports("avx");
+  return ok;
+}
+
+__attribute__((target("avx"))) static size_t fir_dot_avx(const float *x,
+                                                         const float *t,
+                                                         size_t len,
+                                                         float *acc) {
+  __m256 a0 = _mm256_setzero_ps();
+  __m256 a1 = _mm256_setzero_ps();
+  __m256 a2 = _mm256_setzero_ps();
+  __m256 a3 = _mm256_setzero_ps();
+  size_t k = 0;
+  for (; k + 32 <= len; k += 32) {
+    a0 = _mm256_add_ps(
+        a0, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(t + k)));
+    a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x + k + 8),
+                                         _mm256_loadu_ps(t + k + 8)));
+    a2 = _mm256_add_ps(a2, _mm256_mul_ps(_mm256_loadu_ps(x + k + 16),
+                                         _mm256_loadu_ps(t + k + 16)));
+    a3 = _mm256_add_ps(a3, _mm256_mul_ps(_mm256_loadu_ps(x + k + 24),
+                                         _mm256_loadu_ps(t + k + 24)));
+  }
+  for (; k + 8 <= len; k += 8) {
+    a0 = _mm256_add_ps(
+        a0, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_loadu_ps(t + k)));
+  }
+  a0 = _mm256_add_ps(_mm256_add_ps(a0, a1), _mm256_add_ps(a2, a3));
+  _mm256_storeu_ps(acc, a0);
+  return k;
+}
+#endif
+
+/// Dot product of n complex samples with n duplicated taps, out is (I, Q)
+static void fir_dot(const float *x, const float *t, size_t n, float *out) {
+  const size_t len = n * 2;
+  float acc[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  size_t k = 0;
+#ifdef HACKRF_DSP_AVX_DISPATCH
+  if (have_avx()) k = fir_dot_avx(x, t, len, acc);
+#endif
+  for (; k + 8 <= len; k += 8) {
+    for (size_t j = 0; j < 8; ++j) {
+      acc[j] += x[k + j] * t[k + j];
+    }
+  }
+  // len is even and k a multiple of 8, so k & 1 is still the I/Q lane
+  for (; k < len; ++k) {
+    acc[k & 1] += x[k] * t[k];
+  }
+  out[0] = (acc[0] + acc[2]) + (acc[4] + acc[6]);
+  out[1] = (acc[1] + acc[3]) + (acc[5] + acc[7]);
+}
+
+/*******************************************************************
+ * NCO
+ ******************************************************************/
+
+HackRF_NCO::HackRF_NCO(void)
+    : _frequency(0.0), _phase(0), _step(0), _rot(HACKRF_DSP_NCO_BLOCK * 2) {}
+
+void HackRF_NCO::set_frequency(double frequency, double samplerate) {
+  _frequency = frequency;
+  if (samplerate <= 0.0 or frequency == 0.0) {
+    _step = 0;
+    return;
+  }
+
+  // wrap into [0, 1) cycles per sample, then scale to the accumulator
+  double cycles = fmod(frequency / samplerate, 1.0);
+  if (cycles < 0.0) cycles += 1.0;
+  _step = (uint32_t)llround(cycles * 4294967296.0);
+
+  const double w = 2.0 * M_PI * _step / 4294967296.0;
+  for (size_t k = 0; k < HACKRF_DSP_NCO_BLOCK; ++k) {
+    _rot[k * 2] = cos(w * k);
+    _rot[k * 2 + 1] = sin(w * k);
+  }
+}
+
+void HackRF_NCO::mix(float *buf, size_t n) {
+  if (_step == 0) return;
+
+  const float *rot = _rot.data();
+  while (n > 0) {
+    const size_t len = std::min<size_t>(n, HACKRF_DSP_NCO_BLOCK);
+    const double base = 2.0 * M_PI * _phase / 4294967296.0;
+    const float bc = cos(base);
+    const float bs = sin(base);
+
+    for (size_t k = 0; k < len; ++k) {
+      const float rc = bc * rot[k * 2] - bs * rot[k * 2 + 1];
+      const float rs = bc * rot[k * 2 + 1] + bs * rot[k * 2];
+      const float i = buf[k * 2];
+      const float q = buf[k * 2 + 1];
+      buf[k * 2] = i * rc - q * rs;
+      buf[k * 2 + 1] = i * rs + q * rc;
+    }
+
+    _phase += _step * (uint32_t)len;
+    buf += len * 2;
+    n -= len;
+  }
+}
+
+/*******************************************************************
+ * Decimator
+ ******************************************************************/
+
+HackRF_Decimator::HackRF_Decimator(void) : _decim(1), _skip(0) {
+  configure(1, std::vector<float>(1, 1.0f));
+}
+
+void HackRF_Decimator::configure(size_t decim, const std::vector<float> &taps) {
+  _decim = std::max<size_t>(decim, 1);
+  // stored reversed so the inner loop is a forward dot product
+  const std::vector<float> rev(taps.rbegin(), taps.rend());
+  _taps = duplicate_taps(rev.data(), rev.size());
+  reset();
+}
+
+void HackRF_Decimator::reset(void) {
+  _skip = 0;
+  _work.assign(_taps.size() - 2, 0.0f);
+}
+
+size_t HackRF_Decimator::process(const float *in, size_t n, float *out) {
+  const size_t ntaps = _taps.size() / 2;
+  const size_t hist = ntaps - 1;
+  const size_t total = hist + n;
+
+  _work.resize(total * 2);
+  memcpy(&_work[hist * 2], in, n * 2 * sizeof(float));
+
+  const float *taps = _taps.data();
+  size_t produced = 0;
+  size_t i = _skip;
+  for (; i + ntaps <= total; i += _decim) {
+    fir_dot(&_work[i * 2], taps, ntaps, &out[produced * 2]);
+    produced++;
+  }
+
+  // keep the last hist samples and the position of the next output
+  _skip = i - (total - hist);
+  memmove(&_work[0], &_work[(total - hist) * 2], hist * 2 * sizeof(float));
+  _work.resize(hist * 2);
+
+  return produced;
+}
+
+/*******************************************************************
+ * Interpolator
+ ******************************************************************/
+
+HackRF_Interpolator::HackRF_Interpolator(void)
+    : _interp(1), _ntaps(1), _phase(1) {
+  configure(1, std::vector<float>(1, 1.0f));
+}
+
+void HackRF_Interpolator::configure(size_t interp,
+                                    const std::vector<float> &taps) {
+  _interp = std::max<size_t>(interp, 1);
+  _ntaps = (taps.size() + _interp - 1) / _interp;
+
+  // split into branches, each reversed so the dot product runs oldest to
+  // newest over the history window
+  std::vector<float> branches(_interp * _ntaps, 0.0f);
+  for (size_t p = 0; p < _interp; ++p) {
+    for (size_t j = 0; j < _ntaps; ++j) {
+      const size_t k = p + (_ntaps - 1 - j) * _interp;
+      if (k < taps.size()) branches[p * _ntaps + j] = taps[k];
+    }
+  }
+  _taps = duplicate_taps(branches.data(), branches.size());
+  reset();
+}
+
+void HackRF_Interpolator::reset(void) {
+  // every branch of the (zero) newest sample has been emitted
+  _phase = _interp;
+  _work.assign(_ntaps * 2, 0.0f);
+}
+
+size_t HackRF_Interpolator::process(const float *in, size_t n,
+                                    size_t &consumed, float *out,
+                                    size_t max_out) {
+  // max_out outputs never take more inputs than this, so callers can pass
+  // a long backlog without it being copied into _work on every call
+  n = std::min(n, max_out / _interp + 1);
+
+  _work.resize((_ntaps + n) * 2);
+  memcpy(&_work[_ntaps * 2], in, n * 2 * sizeof(float));
+
+  size_t produced = 0;
+  size_t cur = 0;
+  consumed = 0;
+
+  while (produced < max_out) {
+    if (_phase == _interp) {
+      if (consumed == n) break;
+      cur++;
+      consumed++;
+      _phase = 0;
+    }
+
+    fir_dot(&_work[cur * 2], &_taps[_phase * _ntaps * 2], _ntaps,
+            &out[produced * 2]);
+    produced++;
+    _phase++;
+  }
+
+  // the window of the newest consumed sample becomes the history
+  memmove(&_work[0], &_work[cur * 2], _ntaps * 2 * sizeof(float));
+  _work.resize(_ntaps * 2);
+
+  return produced;
+}
+
+/*******************************************************************
+ * Resampler
+ ******************************************************************/
+
+HackRF_Resampler::HackRF_Resampler(void)
+    : _ratio(1.0), _step(1.0), _pos(0.0) {}
+
+void HackRF_Resampler::configure(double ratio) {
+  const size_t P = HACKRF_DSP_RESAMPLER_PHASES;
+  const size_t T = HACKRF_DSP_TAPS_PER_PHASE;
+
+  _ratio = ratio;
+  _step = 1.0 / ratio;
+
+  // prototype at P times the input rate, band limited to the lower of the
+  // two Nyquist rates
+  const std::vector<float> h = HackRF_design_lowpass(
+      P * T, 0.45 * std::min(1.0, ratio) / P, (double)P);
+
+  // P + 1 branches so linear interpolation can always read branch p + 1,
+  // each reversed so the dot product runs oldest to newest
+  std::vector<float> branches((P + 1) * T, 0.0f);
+  for (size_t p = 0; p <= P; ++p) {
+    for (size_t j = 0; j < T; ++j) {
+      const size_t k = p + (T - 1 - j) * P;
+      if (k < h.size()) branches[p * T + j] = h[k];
+    }
+  }
+  _taps = duplicate_taps(branches.data(), branches.size());
+  reset();
+}
+
+void HackRF_Resampler::reset(void) {
+  const size_t T = HACKRF_DSP_TAPS_PER_PHASE;
+  _pos = T - 1;
+  _work.assign((T - 1) * 2, 0.0f);
+}
+
+size_t HackRF_Resampler::max_output(size_t n) const {
+  return (size_t)ceil(n * _ratio) + 2;
+}
+
+size_t HackRF_Resampler::process(const float *in, size_t n, float *out) {
+  const size_t P = HACKRF_DSP_RESAMPLER_PHASES;
+  const size_t T = HACKRF_DSP_TAPS_PER_PHASE;
+  const size_t hist = T - 1;
+  const size_t total = hist + n;
+
+  _work.resize(total * 2);
+  memcpy(&_work[hist * 2], in, n * 2 * sizeof(float));
+
+  // _pos is the next output time in work samples; the window for an output
+  // between samples i and i + 1 ends at i
+  size_t produced = 0;
+  while ((size_t)_pos < total) {
+    const size_t i = (size_t)_pos;
+    const double phase = (_pos - i) * P;
+    const size_t p = (size_t)phase;
+    const float frac = phase - p;
+
+    const float *x = &_work[(i - hist) * 2];
+    float a[2], b[2];
+    fir_dot(x, &_taps[p * T * 2], T, a);
+    fir_dot(x, &_taps[(p + 1) * T * 2], T, b);
+    out[produced * 2] = a[0] + (b[0] - a[0]) * frac;
+    out[produced * 2 + 1] = a[1] + (b[1] - a[1]) * frac;
+    produced++;
+    _pos += _step;
+  }
+
+  _pos -= n;
+  memmove(&_work[0], &_work[n * 2], hist * 2 * sizeof(float));
+  _work.resize(hist * 2);
+
+  return produced;
+}
+
+/*******************************************************************
+ * DDC
+ ******************************************************************/
+
+HackRF_DDC::HackRF_DDC(void) {}
+
+void HackRF_DDC::configure(double offset, double samplerate, size_t decim,
+                           double ratio) {
+  // shift the channel down to 0 Hz, phase continuous across retunes
+  _nco.set_frequency(-offset, samplerate);
+
+  decim = std::max<size_t>(decim, 1);
+  if (decim != _decim.decimation()) {
+    if (decim == 1) {
+      _decim.configure(1, std::vector<float>(1, 1.0f));
+    } else {
+      _decim.configure(decim, HackRF_design_lowpass(
+                                  HACKRF_DSP_TAPS_PER_PHASE * decim + 1,
+                                  0.42 / decim));
+    }
+  }
+
+  if (ratio != _resamp.ratio()) _resamp.configure(ratio);
+}
+
+void HackRF_DDC::reset(void) {
+  _nco.reset();
+  _decim.reset();
+  _resamp.reset();
+}
+
+size_t HackRF_DDC::max_output(size_t n) const {
+  const size_t m = _decim.max_output(n);
+  return (_resamp.ratio() == 1.0) ? m : _resamp.max_output(m);
+}
+
+size_t HackRF_DDC::process(const float *in, size_t n, float *out) {
+  const float *src = in;
+
+  if (_nco.enabled()) {
+    _mix.resize(n * 2);
+    memcpy(_mix.data(), in, n * 2 * sizeof(float));
+    _nco.mix(_mix.data(), n);
+    src = _mix.data();
+  }
+
+  if (_resamp.ratio() == 1.0) {
+    if (_decim.decimation() == 1) {
+      if (src != out) memcpy(out, src, n * 2 * sizeof(float));
+      return n;
+    }
+    return _decim.process(src, n, out);
+  }
+
+  if (_decim.decimation() > 1) {
+    _dec.resize(_decim.max_output(n) * 2);
+    n = _decim.process(src, n, _dec.data());
+    src = _dec.data();
+  }
+  return _resamp.process(src, n, out);
+}
+
+/*******************************************************************
+ * DUC
+ ******************************************************************/
+
+HackRF_DUC::HackRF_DUC(void)
+    : _pending_offset(0), _scratch(HACKRF_DSP_NCO_BLOCK * 16 * 2) {}
+
+void HackRF_DUC::configure(double offset, double samplerate, size_t interp,
+                           double ratio) {
+  _nco.set_frequency(offset, samplerate);
+
+  interp = std::max<size_t>(interp, 1);
+  if (interp != _interp.interpolation()) {
+    if (interp == 1) {
+      _interp.configure(1, std::vector<float>(1, 1.0f));
+    } else {
+      // zero stuffing loses a factor of interp in amplitude, restore it
+      _interp.configure(interp, HackRF_design_lowpass(
+                                    HACKRF_DSP_TAPS_PER_PHASE * interp,
+                                    0.42 / interp, (double)interp));
+    }
+  }
+
+  if (ratio != _resamp.ratio()) _resamp.configure(ratio);
+}
+
+void HackRF_DUC::reset(void) {
+  _nco.reset();
+  _interp.reset();
+  _resamp.reset();
+  _pending.clear();
+  _pending_offset = 0;
+}
+
+void HackRF_DUC::push(const float *in, size_t n) {
+  // drop what has already been pulled before appending
+  _pending.erase(_pending.begin(), _pending.begin() + _pending_offset * 2);
+  _pending_offset = 0;
+
+  const size_t have = _pending.size() / 2;
+  if (_resamp.ratio() == 1.0) {
+    _pending.insert(_pending.end(), in, in + n * 2);
+  } else {
+    _pending.resize((have + _resamp.max_output(n)) * 2);
+    const size_t m = _resamp.process(in, n, &_pending[have * 2]);
+    _pending.resize((have + m) * 2);
+  }
+}
+
+size_t HackRF_DUC::pull(int8_t *out, size_t max_out) {
+  const size_t block = _scratch.size() / 2;
+  size_t produced = 0;
+
+  while (produced < max_out) {
+    size_t used = 0;
+    const size_t k = _interp.process(
+        _pending.data() + _pending_offset * 2, pending(), used,
+        _scratch.data(), std::min(block, max_out - produced));
+    if (k == 0) break;
+
+    _nco.mix(_scratch.data(), k);
+    HackRF_cf32_to_cs8(_scratch.data(), out + produced * 2, k);
+    _pending_offset += used;
+    produced += k;
+  }
+  return produced;
+}
+
+HackRF_FFT::HackRF_FFT(void) : _size(0) {}
+
+void HackRF_FFT::configure(size_t size) {
+  size_t bits = 0;
+  while (((size_t)1 << bits) < size) ++bits;
+  _size = (size_t)1 << bits;
+
+  _bitrev.resize(_size);
+  for (size_t i = 0; i < _size; ++i) {
+    uint32_t r = 0;
+    for (size_t b = 0; b < bits; ++b) r |= ((i >> b) & 1) << (bits - 1 - b);
+    _bitrev[i] = r;
+  }
+
+  // the stage with half length h keeps its h twiddles at offset h - 1
+  _twiddle.resize(_size > 1 ? (_size - 1) * 2 : 0);
+  for (size_t h = 1; h < _size; h *= 2) {
+    for (size_t j = 0; j < h; ++j) {
+      const double a = -M_PI * j / h;
+      _twiddle[(h - 1 + j) * 2] = cos(a);
+      _twiddle[(h - 1 + j) * 2 + 1] = sin(a);
+    }
+  }
+}
+
+void HackRF_FFT::transform(float *buf) const {
+  for (size_t i = 0; i < _size; ++i) {
+    const size_t j = _bitrev[i];
+    if (j > i) {
+      std::swap(buf[i * 2], buf[j * 2]);
+      std::swap(buf[i * 2 + 1], buf[j * 2 + 1]);
+    }
+  }
+
+  for (size_t h = 1; h < _size; h *= 2) {
+    const float *tw = &_twiddle[(h - 1) * 2];
+    for (size_t i = 0; i < _size; i += h * 2) {
+      float *a = buf + i * 2;
+      float *b = buf + (i + h) * 2;
+      for (size_t j = 0; j < h; ++j) {
+        const float wr = tw[j * 2], wi = tw[j * 2 + 1];
+        const float br = b[j * 2] * wr - b[j * 2 + 1] * wi;
+        const float bi = b[j * 2] * wi + b[j * 2 + 1] * wr;
+        b[j * 2] = a[j * 2] - br;
+        b[j * 2 + 1] = a[j * 2 + 1] - bi;
+        a[j * 2] += br;
+        a[j * 2 + 1] += bi;
+      }
+    }
+  }
+}
+
+HackRF_PowerSpectrum::HackRF_PowerSpectrum(void) : _norm(1.0f), _frames(0) {}
+
+void HackRF_PowerSpectrum::configure(size_t size) {
+  _fft.configure(size);
+  const size_t n = _fft.size();
+
+  // 4 term Blackman-Harris, sidelobes below the 8-bit noise floor
+  _window.resize(n);
+  double sum = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    const double x = 2.0 * M_PI * i / n;
+    _window[i] = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2.0 * x) -
+                 0.01168 * cos(3.0 * x);
+    sum += _window[i];
+  }
+  _norm = sum > 0.0 ? (float)(1.0 / (sum * sum)) : 1.0f;
+
+  _work.resize(n * 2);
+  _acc.resize(n);
+  reset();
+}
+
+void HackRF_PowerSpectrum::reset(void) {
+  std::fill(_acc.begin(), _acc.end(), 0.0f);
+  _frames = 0;
+}
+
+void HackRF_PowerSpectrum::accumulate(const float *in) {
+  const size_t n = _fft.size();
+  float *work = _work.data();
+  const float *window = _window.data();
+  for (size_t i = 0; i < n; ++i) {
+    work[i * 2] = in[i * 2] * window[i];
+    work[i * 2 + 1] = in[i * 2 + 1] * window[i];
+  }
+
+  _fft.transform(work);
+
+  float *acc = _acc.data();
+  for (size_t i = 0; i < n; ++i) {
+    acc[i] += work[i * 2] * work[i * 2] + work[i * 2 + 1] * work[i * 2 + 1];
+  }
+  _frames++;
+}
+
+void HackRF_PowerSpectrum::result(std::vector<float> &db) const {
+  const size_t n = _fft.size();
+  db.resize(n);
+  const float scale = _frames > 0 ? _norm / _frames : _norm;
+  for (size_t i = 0; i < n; ++i) {
+    // rotate so the most negative frequency comes first
+    const float p = _acc[(i + n / 2) % n] * scale;
+    db[i] = 10.0f * log10f(std::max(p, 1e-20f));
+  }
+}
+
+HackRF_Correlator::HackRF_Correlator(void) : _length(0), _ref_energy(0.0) {}
+
+void HackRF_Correlator::configure(const std::vector<float> &reference) {
+  _length = reference.size() / 2;
+  _ref_energy = 0.0;
+  for (size_t i = 0; i < _length * 2; ++i) {
+    _ref_energy += (double)reference[i] * reference[i];
+  }
+
+  // blocks of at least four reference lengths keep the overlap cheap
+  _fft.configure(std::max<size_t>(1024, _length * 4));
+  const size_t N = _fft.size();
+  _ref_spectrum.assign(N * 2, 0.0f);
+  std::copy(reference.begin(), reference.begin() + _length * 2,
+            _ref_spectrum.begin());
+  _fft.transform(_ref_spectrum.data());
+  _work.resize(N * 2);
+}
+
+size_t HackRF_Correlator::process(const float *in, size_t n, float *score) {
+  if (_length == 0 or n < _length or _ref_energy <= 0.0) return 0;
+
+  const size_t N = _fft.size();
+  const size_t M = N - _length + 1;
+  const size_t lags = n - _length + 1;
+  const float *ref = _ref_spectrum.data();
+  float *work = _work.data();
+
+  for (size_t b = 0; b < lags; b += M) {
+    const size_t count = std::min(N, n - b);
+    std::copy(in + b * 2, in + (b + count) * 2, work);
+    std::fill(work + count * 2, work + N * 2, 0.0f);
+
+    // X * conj(R), then an inverse transform done as a forward transform
+    // of the conjugate
+    _fft.transform(work);
+    for (size_t i = 0; i < N; ++i) {
+      const float xr = work[i * 2], xi = work[i * 2 + 1];
+      const float rr = ref[i * 2], ri = ref[i * 2 + 1];
+      work[i * 2] = xr * rr + xi * ri;
+      work[i * 2 + 1] = -(xi * rr - xr * ri);
+    }
+    _fft.transform(work);
+
+    const size_t valid = std::min(M, lags - b);
+    const double norm = 1.0 / ((double)N * N * _ref_energy);
+    for (size_t j = 0; j < valid; ++j) {
+      score[b + j] = (float)((double)work[j * 2] * work[j * 2] +
+                             (double)work[j * 2 + 1] * work[j * 2 + 1]) *
+                     norm;
+    }
+  }
+
+  // divide by the signal energy under each lag, a running sum in double
+  double energy = 0.0;
+  for (size_t k = 0; k < _length; ++k) {
+    energy +=
+        (double)in[k * 2] * in[k * 2] + (double)in[k * 2 + 1] * in[k * 2 + 1];
+  }
+  for (size_t j = 0; j < lags; ++j) {
+    score[j] = energy > 0.0 ? (float)(score[j] / energy) : 0.0f;
+    if (j + 1 < lags) {
+      const size_t out = j, add = j + _length;
+      energy += (double)in[add * 2] * in[add * 2] +
+                (double)in[add * 2 + 1] * in[add * 2 + 1] -
+                (double)in[out * 2] * in[out * 2] -
+                (double)in[out * 2 + 1] * in[out * 2 + 1];
+    }
+  }
+  return lags;
+}
@@ -0,0 +1,327 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/*
+ * All sample buffers handled here are interleaved complex float (I, Q, I, Q,
+ * ...) and all lengths are in complex samples. The FIR filters share one
+ * dot product kernel: taps are stored duplicated per I/Q lane and summed
+ * into independent partial sums, with an AVX path picked at runtime on x86
+ * and a portable path the compiler vectorizes (-ftree-vectorize is set for
+ * HackRF_DSP.cpp).
+ */
+
+#define HACKRF_DSP_NCO_BLOCK 256
+#define HACKRF_DSP_TAPS_PER_PHASE 16
+#define HACKRF_DSP_RESAMPLER_PHASES 32
+
+/// Convert n CS8 samples to complex float in the range [-1.0, 1.0)
+void HackRF_cs8_to_cf32(const int8_t *src, float *dst, size_t n);
+
+/// Mean power of n CS8 samples, 1.0 for a full scale complex tone
+float HackRF_cs8_power(const int8_t *src, size_t n);
+
+/// Convert n complex float samples to CS8, saturating at full scale
+void HackRF_cf32_to_cs8(const float *src, int8_t *dst, size_t n);
+
+/*!
+ * IEEE half precision conversion of count individual floats (not complex
+ * samples). Uses F16C when the CPU has it, checked once at runtime, and a
+ * round-to-nearest-even scalar path otherwise.
+ */
+void HackRF_f32_to_f16(const float *src, uint16_t *dst, size_t count);
+
+void HackRF_f16_to_f32(const uint16_t *src, float *dst, size_t count);
+
+/// Convert n CS8 samples to CF16, multiplying by scale on the way
+void HackRF_cs8_to_cf16(const int8_t *src, uint16_t *dst, size_t n,
+                        float scale);
+
+/// Windowed-sinc (Blackman) low pass prototype, cutoff normalised to fs
+std::vector<float> HackRF_design_lowpass(size_t ntaps, double cutoff,
+                                         double gain = 1.0);
+
+/*!
+ * Rate planner. Finds the smallest integer factor that takes rate to at
+ * least min_rate, preferring a factor that lands on a whole number of Hz so
+ * no fractional resampling is needed. The board rate is rounded up to whole
+ * Hz otherwise, leaving a resampling ratio just off 1.0.
+ */
+double HackRF_plan_board_rate(double rate, double min_rate, double max_rate,
+                              size_t &factor);
+
+/*!
+ * Numerically controlled oscillator. The phase is a 32-bit accumulator, so
+ * the frequency resolution is samplerate / 2^32 and the phase never drifts.
+ * Mixing runs in blocks of HACKRF_DSP_NCO_BLOCK samples against a
+ * precomputed rotator table, re-anchored from the accumulator every block.
+ */
+class HackRF_NCO {
+ public:
+  HackRF_NCO(void);
+
+  void set_frequency(double frequency, double samplerate);
+
+  double get_frequency(void) const { return _frequency; }
+
+  bool enabled(void) const { return _step != 0; }
+
+  void reset(void) { _phase = 0; }
+
+  /// Multiply n samples in place by exp(j * 2pi * f * t)
+  void mix(float *buf, size_t n);
+
+ private:
+  double _frequency;
+  uint32_t _phase;
+  uint32_t _step;
+  std::vector<float> _rot;
+};
+
+/*!
+ * Polyphase decimating FIR. Only the retained output samples are computed,
+ * and the filter history is carried across calls so buffers of any length
+ * may be fed in.
+ */
+class HackRF_Decimator {
+ public:
+  HackRF_Decimator(void);
+
+  void configure(size_t decim, const std::vector<float> &taps);
+
+  size_t decimation(void) const { return _decim; }
+
+  void reset(void);
+
+  /// Filter n input samples, returns the number written to out
+  size_t process(const float *in, size_t n, float *out);
+
+  /// Upper bound on the number of samples process() produces for n inputs
+  size_t max_output(size_t n) const { return n / _decim + 1; }
+
+ private:
+  size_t _decim;
+  size_t _skip;
+  std::vector<float> _taps;
+  std::vector<float> _work;
+};
+
+/*!
+ * Polyphase interpolating FIR. Output is produced one polyphase branch at a
+ * time, so a call may stop part way through the branches of an input sample
+ * when the output space runs out and pick up there on the next call.
+ */
+class HackRF_Interpolator {
+ public:
+  HackRF_Interpolator(void);
+
+  void configure(size_t interp, const std::vector<float> &taps);
+
+  size_t interpolation(void) const { return _interp; }
+
+  void reset(void);
+
+  /// Produce at most max_out samples from n inputs. consumed is set to the
+  /// number of inputs taken, the return value is the number of outputs.
+  size_t process(const float *in, size_t n, size_t &consumed, float *out,
+                 size_t max_out);
+
+ private:
+  size_t _interp;
+  size_t _ntaps;
+  size_t _phase;
+  std::vector<float> _taps;
+  std::vector<float> _work;
+};
+
+/*!
+ * Arbitrary ratio resampler: a HACKRF_DSP_RESAMPLER_PHASES branch polyphase
+ * filter indexed by a phase accumulator, with linear interpolation between
+ * adjacent branches. Intended for ratios near 1.0, the integer part of a
+ * rate change belongs in the decimator or interpolator.
+ */
+class HackRF_Resampler {
+ public:
+  HackRF_Resampler(void);
+
+  /// ratio is output rate / input rate, 1.0 passes samples straight through
+  void configure(double ratio);
+
+  double ratio(void) const { return _ratio; }
+
+  void reset(void);
+
+  /// Consume all n inputs, returns the number of outputs written
+  size_t process(const float *in, size_t n, float *out);
+
+  size_t max_output(size_t n) const;
+
+ private:
+  double _ratio;
+  double _step;
+  double _pos;
+  std::vector<float> _taps;
+  std::vector<float> _work;
+};
+
+/*!
+ * Digital down converter for one virtual channel: NCO shift to baseband,
+ * low pass decimation, then fractional resampling to the exact rate.
+ */
+class HackRF_DDC {
+ public:
+  HackRF_DDC(void);
+
+  /// Reconfiguring keeps filter state when only the offset changes
+  void configure(double offset, double samplerate, size_t decim,
+                 double ratio = 1.0);
+
+  void reset(void);
+
+  size_t process(const float *in, size_t n, float *out);
+
+  size_t max_output(size_t n) const;
+
+ private:
+  HackRF_NCO _nco;
+  HackRF_Decimator _decim;
+  HackRF_Resampler _resamp;
+  std::vector<float> _mix;
+  std::vector<float> _dec;
+};
+
+/*!
+ * Digital up converter for the TX path: fractional resampling, polyphase
+ * interpolation and an NCO shift, quantised straight into a CS8 transfer
+ * buffer. Samples are push()ed in at the application rate and pull()ed out
+ * at the board rate, anything not yet pulled is held in the DUC.
+ */
+class HackRF_DUC {
+ public:
+  HackRF_DUC(void);
+
+  /// Reconfiguring keeps queued samples and filter state where possible
+  void configure(double offset, double samplerate, size_t interp,
+                 double ratio = 1.0);
+
+  void reset(void);
+
+  size_t interpolation(void) const { return _interp.interpolation(); }
+
+  void push(const float *in, size_t n);
+
+  /// Write at most max_out board rate samples, returns the number written
+  size_t pull(int8_t *out, size_t max_out);
+
+  /// Samples pushed but not yet interpolated, at the interpolator input rate
+  size_t pending(void) const { return _pending.size() / 2 - _pending_offset; }
+
+ private:
+  HackRF_Resampler _resamp;
+  HackRF_Interpolator _interp;
+  HackRF_NCO _nco;
+  std::vector<float> _pending;
+  size_t _pending_offset;
+  std::vector<float> _scratch;
+};
+
+/*!
+ * Radix-2 complex FFT, size a power of two. Twiddles are stored per stage
+ * so every butterfly pass reads them with unit stride.
+ */
+class HackRF_FFT {
+ public:
+  HackRF_FFT(void);
+
+  void configure(size_t size);
+
+  size_t size(void) const { return _size; }
+
+  /// Forward transform of size samples in place
+  void transform(float *buf) const;
+
+ private:
+  size_t _size;
+  std::vector<uint32_t> _bitrev;
+  std::vector<float> _twiddle;
+};
+
+/*!
+ * Averaged power spectrum. Frames of size() samples are Blackman-Harris
+ * windowed, transformed and their power summed until result() turns the sum
+ * into dBFS bins, DC in the middle, normalised so a full scale tone centred
+ * on a bin reads 0 dB.
+ */
+class HackRF_PowerSpectrum {
+ public:
+  HackRF_PowerSpectrum(void);
+
+  void configure(size_t size);
+
+  size_t size(void) const { return _fft.size(); }
+
+  size_t frames(void) const { return _frames; }
+
+  void reset(void);
+
+  void accumulate(const float *in);
+
+  /// Average of the frames since the last reset, in dBFS
+  void result(std::vector<float> &db) const;
+
+ private:
+  HackRF_FFT _fft;
+  std::vector<float> _window;
+  float _norm;
+  std::vector<float> _work;
+  std::vector<float> _acc;
+  size_t _frames;
+};
+
+/*!
+ * Normalised sliding cross-correlation against a reference sequence, by FFT
+ * overlap-save. The score at each lag is |<x, r>|^2 / (|x|^2 |r|^2), 1.0
+ * for an exact (scaled, phase rotated) copy of the reference.
+ */
+class HackRF_Correlator {
+ public:
+  HackRF_Correlator(void);
+
+  void configure(const std::vector<float> &reference);
+
+  size_t length(void) const { return _length; }
+
+  /// Score every lag of the reference that fits in the n samples of in,
+  /// returns the number of scores written, n - length() + 1 or 0
+  size_t process(const float *in, size_t n, float *score);
+
+ private:
+  size_t _length;
+  double _ref_energy;
+  HackRF_FFT _fft;
+  std::vector<float> _ref_spectrum;
+  std::vector<float> _work;
+};
@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <SoapySDR/Logger.hpp>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * A stream's descriptor becomes readable whenever the RX callback commits a
+ * buffer, or the TX callback frees a ring slot or queues a burst ack. It is
+ * an eventfd on Linux and the read end of a non-blocking pipe elsewhere.
+ * Readiness is edge-like: read the descriptor to clear it, then call
+ * readStream() or writeStream() with a zero timeout until it returns
+ * SOAPY_SDR_TIMEOUT. Spurious wakeups are possible, missed ones are not,
+ * since every commit after the clear signals again.
+ */
+
+int SoapyHackRFDuplex::StreamNotifier::open(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (read_fd >= 0) return read_fd;
+
+#ifdef __linux__
+  const int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "eventfd() failed -- %s", strerror(errno));
+    return -1;
+  }
+  write_fd = fd;
+  read_fd = fd;
+#else
+  int fds[2];
+  if (pipe(fds) != 0) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "pipe() failed -- %s", strerror(errno));
+    return -1;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+  }
+  write_fd = fds[1];
+  read_fd = fds[0];
+#endif
+
+  // the stream may already be ready, let the first poll find out
+  this->signal();
+  return read_fd;
+}
+
+void SoapyHackRFDuplex::StreamNotifier::signal(void) {
+  const int fd = write_fd;
+  if (fd < 0) return;
+
+  // a full counter or pipe already reads as ready, nothing to do on EAGAIN
+#ifdef __linux__
+  const uint64_t one = 1;
+#else
+  const uint8_t one = 1;
+#endif
+  ssize_t ret = write(fd, &one, sizeof(one));
+  (void)ret;
+}
+
+void SoapyHackRFDuplex::StreamNotifier::close(void) {
+  std::lock_guard<std::mutex> lock(mutex);
+  const int rfd = read_fd.exchange(-1);
+  const int wfd = write_fd.exchange(-1);
+  if (wfd >= 0 and wfd != rfd) ::close(wfd);
+  if (rfd >= 0) ::close(rfd);
+}
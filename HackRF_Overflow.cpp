@@ -0,0 +1,169 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Logger.hpp>
+#include <cstdlib>
+#include <cstring>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * RX overflow policies. A full ring either overwrites its oldest committed
+ * transfer (drop_oldest), drops the incoming one (drop_newest) or parks it
+ * in a preallocated spill arena (spill). Spilled transfers go back into the
+ * ring as the reader frees slots, by swapping buffer pointers, and while any
+ * are parked every new transfer queues behind them to keep the order. Only
+ * a full arena loses data, newest first.
+ *
+ * Whatever is lost is accounted by sample index, which runs on through
+ * losses, so a gap is exact: contiguous losses extend it and the next
+ * transfer that is kept closes it. The reader is told in stream order, at
+ * the first buffer past the gap. All of this runs under _rx_buf_mutex.
+ */
+
+void SoapyHackRFDuplex::RXStream::allocate_spill(uint32_t count) {
+  clear_spill();
+  for (uint32_t i = 0; i < count; ++i) {
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, HACKRF_BUF_ALIGN, buf_len) != 0) break;
+    spill_free.push_back((int8_t *)ptr);
+  }
+}
+
+void SoapyHackRFDuplex::RXStream::clear_spill() {
+  for (size_t i = 0; i < spill.size(); ++i) free(spill[i].buf);
+  for (size_t i = 0; i < spill_free.size(); ++i) free(spill_free[i]);
+  spill.clear();
+  spill_free.clear();
+}
+
+void SoapyHackRFDuplex::note_rx_loss(uint64_t index, uint64_t samps,
+                                     long long time) {
+  RXStream &s = _rx_stream;
+  if (samps == 0) return;
+  s.samples_lost += samps;
+
+  if (s.gap_samps > 0 and index == s.gap_index + s.gap_samps) {
+    s.gap_samps += samps;
+    return;
+  }
+  this->close_rx_gap();
+  s.gap_index = index;
+  s.gap_samps = samps;
+  s.gap_time = time;
+
+  // reported when the reader gets there, after what was queued before it
+  if (s.overflow_marks.size() == HACKRF_RX_GAPS) s.overflow_marks.pop_front();
+  s.overflow_marks.push_back(std::make_pair(index, time));
+}
+
+void SoapyHackRFDuplex::close_rx_gap(void) {
+  RXStream &s = _rx_stream;
+  if (s.gap_samps == 0) return;
+
+  SoapySDR_logf(SOAPY_SDR_DEBUG, "RX lost %llu samples at index %llu",
+                (unsigned long long)s.gap_samps,
+                (unsigned long long)s.gap_index);
+  if (s.gaps.size() == HACKRF_RX_GAPS) s.gaps.pop_front();
+  s.gaps.push_back(std::to_string(s.gap_index) + "+" +
+                   std::to_string(s.gap_samps));
+  if (s.events.size() == HACKRF_RX_GAPS) s.events.pop_front();
+  s.events.push_back(StreamEvent(
+      SOAPY_SDR_OVERFLOW, SOAPY_SDR_END_ABRUPT | SOAPY_SDR_HAS_TIME,
+      s.gap_time));
+  s.gap_samps = 0;
+}
+
+bool SoapyHackRFDuplex::spill_rx(const int8_t *src, uint32_t samps,
+                                 uint64_t index, long long time,
+                                 bool burst_end) {
+  RXStream &s = _rx_stream;
+  if (s.spill_free.empty()) {
+    this->note_rx_loss(index, samps, time);
+    return false;
+  }
+
+  RXSpill sp;
+  sp.buf = s.spill_free.back();
+  s.spill_free.pop_back();
+  memcpy(sp.buf, src, samps * BYTES_PER_SAMPLE);
+  sp.samps = samps;
+  sp.index = index;
+  sp.time = time;
+  sp.burst_end = burst_end;
+  s.spill.push_back(sp);
+  this->close_rx_gap();
+  return true;
+}
+
+void SoapyHackRFDuplex::spill_rx_history(void) {
+  RXStream &s = _rx_stream;
+  const uint32_t first = (s.buf_head + s.buf_count - s.buf_held) % s.buf_num;
+
+  // the history slots trade buffers with the arena rather than copying
+  for (uint32_t i = 0; i < s.history_pending; ++i) {
+    const uint32_t slot = (first + i) % s.buf_num;
+    if (s.spill_free.empty()) {
+      this->note_rx_loss(s.buf_index[slot], s.buf_samps[slot],
+                         s.buf_time[slot]);
+      continue;
+    }
+    RXSpill sp;
+    sp.buf = s.buf[slot];
+    sp.samps = s.buf_samps[slot];
+    sp.index = s.buf_index[slot];
+    sp.time = s.buf_time[slot];
+    sp.burst_end = s.buf_burst_end[slot];
+    s.buf[slot] = s.spill_free.back();
+    s.spill_free.pop_back();
+    s.spill.push_back(sp);
+  }
+  s.history_pending = 0;
+}
+
+void SoapyHackRFDuplex::unspill_rx(void) {
+  RXStream &s = _rx_stream;
+  if (s.buf == nullptr) return;
+
+  // nothing is kept as history while the arena holds transfers, so the
+  // free slots follow the committed ones directly
+  while (not s.spill.empty() and s.history_pending == 0 and
+         s.buf_count < s.buf_num) {
+    const uint32_t slot = (s.buf_head + s.buf_count - s.buf_held) % s.buf_num;
+    RXSpill &sp = s.spill.front();
+    s.spill_free.push_back(s.buf[slot]);
+    s.buf[slot] = sp.buf;
+    s.buf_samps[slot] = sp.samps;
+    s.buf_index[slot] = sp.index;
+    s.buf_time[slot] = sp.time;
+    s.buf_burst_end[slot] = sp.burst_end;
+    s.buf_count++;
+    s.spill.pop_front();
+  }
+}
+
+void SoapyHackRFDuplex::drop_rx_spill(void) {
+  RXStream &s = _rx_stream;
+  for (size_t i = 0; i < s.spill.size(); ++i) {
+    s.spill_free.push_back(s.spill[i].buf);
+  }
+  s.spill.clear();
+}
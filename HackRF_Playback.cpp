@@ -0,0 +1,218 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * Playback maps a CS8 capture and the TX callback copies from the mapping
+ * straight into the USB transfer, so no application thread, ring buffer or
+ * conversion sits in the path. The kernel is told the access is sequential
+ * and the next few transfers are prefetched with MADV_WILLNEED as the
+ * position moves, which keeps page faults out of the callback.
+ */
+
+static bool ends_with(const std::string &str, const std::string &suffix) {
+  return str.size() >= suffix.size() and
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+/// Pull a string or number value for key out of a SigMF metadata file
+static std::string sigmf_value(const std::string &meta,
+                               const std::string &key) {
+  size_t pos = meta.find("\"" + key + "\"");
+  if (pos == std::string::npos) return "";
+  pos = meta.find(':', pos + key.size() + 2);
+  if (pos == std::string::npos) return "";
+  pos = meta.find_first_not_of(" \t\r\n", pos + 1);
+  if (pos == std::string::npos) return "";
+  if (meta[pos] == '"') {
+    const size_t end = meta.find('"', pos + 1);
+    if (end == std::string::npos) return "";
+    return meta.substr(pos + 1, end - pos - 1);
+  }
+  const size_t end = meta.find_first_of(",}\r\n", pos);
+  return meta.substr(pos, end - pos);
+}
+
+int SoapyHackRFDuplex::start_playback(const std::string &path) {
+  if (_playback.active) this->stop_playback();
+
+  // a SigMF dataset may be named by either of its files
+  std::string data_path = path;
+  std::string meta_path;
+  if (ends_with(path, ".sigmf-meta")) {
+    meta_path = path;
+    data_path = path.substr(0, path.size() - 11) + ".sigmf-data";
+  } else if (ends_with(path, ".sigmf-data")) {
+    meta_path = path.substr(0, path.size() - 11) + ".sigmf-meta";
+  }
+
+  double file_rate = 0.0;
+  if (not meta_path.empty()) {
+    std::ifstream meta_file(meta_path.c_str());
+    if (meta_file) {
+      std::stringstream meta;
+      meta << meta_file.rdbuf();
+      const std::string datatype = sigmf_value(meta.str(), "core:datatype");
+      if (datatype != "ci8") {
+        SoapySDR_logf(SOAPY_SDR_ERROR,
+                      "Playback needs ci8 samples, %s is %s",
+                      meta_path.c_str(), datatype.c_str());
+        return SOAPY_SDR_NOT_SUPPORTED;
+      }
+      file_rate = atof(sigmf_value(meta.str(), "core:sample_rate").c_str());
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_tx_device_mutex);
+    if (_tx_stream.opened) {
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "Playback needs the TX stream to be closed");
+      return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    if (file_rate > 0 and
+        std::fabs(file_rate - _tx_stream.samplerate) > file_rate * 1e-6) {
+      SoapySDR_logf(_playback.rate_check ? SOAPY_SDR_ERROR : SOAPY_SDR_WARNING,
+                    "%s was captured at %f Sps, TX runs at %f Sps",
+                    data_path.c_str(), file_rate, _tx_stream.samplerate);
+      if (_playback.rate_check) return SOAPY_SDR_NOT_SUPPORTED;
+    }
+  }
+
+  const int fd = open(data_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Could not open %s -- %s",
+                  data_path.c_str(), strerror(errno));
+    return SOAPY_SDR_STREAM_ERROR;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 or st.st_size < BYTES_PER_SAMPLE) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "%s is empty", data_path.c_str());
+    close(fd);
+    return SOAPY_SDR_STREAM_ERROR;
+  }
+
+  const size_t size = st.st_size;
+  void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping holds its own reference to the file
+  close(fd);
+  if (map == MAP_FAILED) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Could not map %s -- %s",
+                  data_path.c_str(), strerror(errno));
+    return SOAPY_SDR_STREAM_ERROR;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    _playback.path = data_path;
+    _playback.map = (const int8_t *)map;
+    _playback.map_size = size;
+    _playback.data_size = size - size % BYTES_PER_SAMPLE;
+    _playback.pos = std::min<size_t>(_playback.offset * BYTES_PER_SAMPLE,
+                                     _playback.data_size);
+    _playback.advised = _playback.pos;
+    _playback.finished = false;
+    _playback.active = true;
+  }
+
+  this->setupStream(SOAPY_SDR_TX, SOAPY_SDR_CS8);
+  _playback.owns_tx = true;
+
+  int ret = this->activateStream(TX_STREAM);
+  if (ret != 0) {
+    this->stop_playback();
+    return ret;
+  }
+
+  SoapySDR_logf(SOAPY_SDR_INFO, "Playing %s%s", data_path.c_str(),
+                _playback.loop ? " in a loop" : "");
+  return 0;
+}
+
+void SoapyHackRFDuplex::stop_playback(void) {
+  if (_playback.owns_tx) {
+    this->closeStream(TX_STREAM);
+    _playback.owns_tx = false;
+  }
+
+  std::lock_guard<std::mutex> lock(_playback_mutex);
+  _playback.active = false;
+  if (_playback.map) {
+    munmap((void *)_playback.map, _playback.map_size);
+    _playback.map = nullptr;
+    _playback.map_size = 0;
+  }
+}
+
+void SoapyHackRFDuplex::playback_fill(int8_t *buffer, int32_t length) {
+  static const size_t page = sysconf(_SC_PAGESIZE);
+
+  std::lock_guard<std::mutex> lock(_playback_mutex);
+  const int8_t *data = _playback.map;
+  size_t done = 0;
+
+  while (done < (size_t)length) {
+    if (_playback.map == nullptr or _playback.finished) {
+      memset(buffer + done, 0, length - done);
+      return;
+    }
+
+    const size_t n =
+        std::min(length - done, _playback.data_size - _playback.pos);
+    memcpy(buffer + done, data + _playback.pos, n);
+    done += n;
+    _playback.pos += n;
+
+    if (_playback.pos == _playback.data_size) {
+      if (_playback.loop) {
+        _playback.pos = 0;
+        _playback.advised = 0;
+      } else {
+        _playback.finished = true;
+      }
+    }
+  }
+
+  // keep the next few transfers resident ahead of the callback
+  if (_playback.pos + HACKRF_PLAYBACK_READAHEAD > _playback.advised and
+      _playback.advised < _playback.data_size) {
+    const size_t from = _playback.pos & ~(page - 1);
+    const size_t len = std::min<size_t>(2 * HACKRF_PLAYBACK_READAHEAD,
+                                        _playback.map_size - from);
+    madvise((void *)(_playback.map + from), len, MADV_WILLNEED);
+    _playback.advised = from + len;
+  }
+}
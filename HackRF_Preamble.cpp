@@ -0,0 +1,252 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * The preamble detector takes the RX stream over from the ring: the RX
+ * callback hands each transfer to a worker thread, which correlates it
+ * against the reference and queues only a window of pre samples before and
+ * post samples after each detection, one ring slot per window. Each window
+ * is delivered as a burst, time stamped by its first sample index, so every
+ * consumer reads detections instead of correlating the full rate stream
+ * itself. Windows may reach back into the previous transfer and forward
+ * into the next.
+ */
+
+int SoapyHackRFDuplex::start_preamble(void) {
+  if (_preamble.worker.joinable()) return 0;
+
+  {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    if (_preamble.reference.empty()) {
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "preamble detection needs preamble_reference first");
+      return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    _preamble.pool.resize(HACKRF_PREAMBLE_BUF_NUM);
+    for (size_t i = 0; i < _preamble.pool.size(); ++i) {
+      _preamble.pool[i].resize(_rx_stream.buf_len);
+    }
+    _preamble.pool_index.assign(HACKRF_PREAMBLE_BUF_NUM, 0);
+    _preamble.head = 0;
+    _preamble.count = 0;
+    _preamble.stop = false;
+    _preamble.detections = 0;
+    _preamble.dropped = 0;
+    _preamble.reference_changed = true;
+  }
+  _preamble.worker = std::thread(&SoapyHackRFDuplex::preamble_worker, this);
+
+  {
+    // history held for the squelch no longer leads anywhere
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    _rx_stream.history_pending = 0;
+  }
+  _preamble.active = true;
+  return 0;
+}
+
+void SoapyHackRFDuplex::stop_preamble(void) {
+  if (not _preamble.worker.joinable()) return;
+
+  _preamble.active = false;
+  {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    _preamble.stop = true;
+  }
+  _preamble.cond.notify_one();
+  _preamble.worker.join();
+}
+
+void SoapyHackRFDuplex::preamble_push(const int8_t *buffer, uint32_t length,
+                                      uint64_t index) {
+  std::lock_guard<std::mutex> lock(_preamble_mutex);
+  if (not _preamble.active or _preamble.pool.empty()) return;
+
+  if (_preamble.count == _preamble.pool.size()) {
+    // the worker restarts its history at the next index it sees
+    _preamble.dropped += length / BYTES_PER_SAMPLE;
+    return;
+  }
+
+  const uint32_t slot =
+      (_preamble.head + _preamble.count) % _preamble.pool.size();
+  std::vector<int8_t> &buf = _preamble.pool[slot];
+  buf.assign(buffer, buffer + length);
+  _preamble.pool_index[slot] = index;
+  _preamble.count++;
+  _preamble.cond.notify_one();
+}
+
+void SoapyHackRFDuplex::preamble_worker(void) {
+  std::unique_lock<std::mutex> lock(_preamble_mutex);
+
+  while (true) {
+    _preamble.cond.wait(
+        lock, [this] { return _preamble.count > 0 or _preamble.stop; });
+    if (_preamble.stop) break;
+
+    if (_preamble.reference_changed) {
+      _preamble.correlator.configure(_preamble.reference);
+      _preamble.raw.clear();
+      _preamble.conv.clear();
+      _preamble.peaks.clear();
+      _preamble.in_run = false;
+      _preamble.reference_changed = false;
+    }
+    const float threshold = _preamble.threshold;
+    const size_t pre = _preamble.pre;
+    const size_t post = _preamble.post;
+
+    // the slot at head is owned by the worker until head moves on
+    const uint32_t slot = _preamble.head;
+    const std::vector<int8_t> &buf = _preamble.pool[slot];
+    const uint64_t index = _preamble.pool_index[slot];
+    lock.unlock();
+
+    this->preamble_process(buf.data(), buf.size() / BYTES_PER_SAMPLE, index,
+                           threshold, pre, post);
+
+    lock.lock();
+    _preamble.head = (_preamble.head + 1) % _preamble.pool.size();
+    _preamble.count--;
+  }
+}
+
+void SoapyHackRFDuplex::preamble_process(const int8_t *buffer, size_t n,
+                                         uint64_t index, float threshold,
+                                         size_t pre, size_t post) {
+  PreambleDetector &d = _preamble;
+  const size_t L = d.correlator.length();
+  if (L == 0) return;
+
+  // a dropped transfer breaks the history, start again from this one
+  if (d.raw.empty() or index != d.raw_start + d.raw.size() / BYTES_PER_SAMPLE) {
+    d.raw.clear();
+    d.conv.clear();
+    d.peaks.clear();
+    d.in_run = false;
+    d.raw_start = index;
+    d.scored = index;
+    d.holdoff = index;
+  }
+
+  const size_t have = d.raw.size() / BYTES_PER_SAMPLE;
+  d.raw.insert(d.raw.end(), buffer, buffer + n * BYTES_PER_SAMPLE);
+  d.conv.resize((have + n) * 2);
+  HackRF_cs8_to_cf32(buffer, &d.conv[have * 2], n);
+  const uint64_t end = d.raw_start + have + n;
+
+  // score every lag the new samples complete
+  const size_t avail = end - d.scored;
+  if (avail >= L) {
+    d.scores.resize(avail - L + 1);
+    const size_t lags = d.correlator.process(
+        &d.conv[(d.scored - d.raw_start) * 2], avail, d.scores.data());
+    for (size_t j = 0; j < lags; ++j) {
+      const uint64_t pos = d.scored + j;
+      const bool above = d.scores[j] >= threshold and pos >= d.holdoff;
+      if (above and (not d.in_run or d.scores[j] > d.run_max)) {
+        d.run_max = d.scores[j];
+        d.run_peak = pos;
+      }
+      // the peak of a run above the threshold is the detection
+      if (d.in_run and (not above or pos >= d.run_peak + L)) {
+        d.peaks.push_back(d.run_peak);
+        d.holdoff = d.run_peak + L;
+        d.in_run = false;
+      } else if (above) {
+        d.in_run = true;
+      }
+    }
+    d.scored += lags;
+  }
+
+  // windows go out once their last sample has arrived
+  while (not d.peaks.empty() and d.peaks.front() + post <= end) {
+    const uint64_t peak = d.peaks.front();
+    d.peaks.pop_front();
+    const uint64_t start =
+        std::max<uint64_t>(d.raw_start, peak >= pre ? peak - pre : 0);
+    this->commit_rx_window(&d.raw[(start - d.raw_start) * BYTES_PER_SAMPLE],
+                           peak + post - start, start);
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    d.detections++;
+  }
+
+  // keep what a pending or future window can still reach back to
+  uint64_t keep = d.scored;
+  if (not d.peaks.empty()) keep = std::min(keep, d.peaks.front());
+  if (d.in_run) keep = std::min(keep, d.run_peak);
+  keep = std::max<uint64_t>(d.raw_start, keep >= pre ? keep - pre : 0);
+  const size_t drop = keep - d.raw_start;
+  if (drop > 0) {
+    d.raw.erase(d.raw.begin(), d.raw.begin() + drop * BYTES_PER_SAMPLE);
+    d.conv.erase(d.conv.begin(), d.conv.begin() + drop * 2);
+    d.raw_start = keep;
+  }
+}
+
+void SoapyHackRFDuplex::commit_rx_window(const int8_t *buffer, size_t samps,
+                                         uint64_t index) {
+  std::unique_lock<std::mutex> lock(_rx_buf_mutex);
+  const uint32_t num = _rx_stream.buf_num;
+  if (_rx_stream.buf == nullptr) return;
+
+  const long long time_ns =
+      _rx_stream.start_time_ns +
+      (_rx_stream.samplerate > 0
+           ? (long long)(index * 1e9 / _rx_stream.samplerate)
+           : 0);
+  samps = std::min<size_t>(samps, _rx_stream.buf_len / BYTES_PER_SAMPLE);
+
+  if (_rx_stream.overflow_policy == HACKRF_OVERFLOW_SPILL and
+      (not _rx_stream.spill.empty() or _rx_stream.buf_count == num)) {
+    this->spill_rx(buffer, samps, index, time_ns, true);
+    this->unspill_rx();
+    return;
+  }
+  if (_rx_stream.buf_count == num) {
+    // the reader is behind, the detection is lost; queued windows are
+    // never overwritten whatever the policy
+    this->note_rx_loss(index, samps, time_ns);
+    return;
+  }
+  this->close_rx_gap();
+
+  const uint32_t slot =
+      (_rx_stream.buf_head + _rx_stream.buf_count - _rx_stream.buf_held) % num;
+  memcpy(_rx_stream.buf[slot], buffer, samps * BYTES_PER_SAMPLE);
+  _rx_stream.buf_samps[slot] = samps;
+  _rx_stream.buf_index[slot] = index;
+  _rx_stream.buf_time[slot] = time_ns;
+  _rx_stream.buf_burst_end[slot] = 1;
+  _rx_stream.buf_count++;
+
+  _rx_buf_cond.notify_one();
+  lock.unlock();
+  _rx_notify.signal();
+}
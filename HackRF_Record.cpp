@@ -0,0 +1,331 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <sstream>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * RX recording copies each transfer from the RX callback into a pool of page
+ * aligned buffers, and a writer thread drains the pool to a SigMF dataset.
+ * The data file is opened with O_DIRECT where the platform and filesystem
+ * allow it, so a page cache flush can not stall the writer behind unrelated
+ * dirty pages. When the pool is full the transfer is dropped and the gap is
+ * recorded as a new SigMF capture segment with its global index. A failed
+ * write is a gap too; after an unrecoverable error the writer keeps
+ * draining the pool but drops everything, so the file stays contiguous.
+ */
+
+static std::string sigmf_base(const std::string &path) {
+  const std::string ext = ".sigmf-data";
+  if (path.size() > ext.size() and
+      path.compare(path.size() - ext.size(), ext.size(), ext) == 0) {
+    return path.substr(0, path.size() - ext.size());
+  }
+  return path;
+}
+
+static std::string utc_datetime(void) {
+  char str[32];
+  const time_t now = time(nullptr);
+  struct tm tm_now;
+  gmtime_r(&now, &tm_now);
+  strftime(str, sizeof(str), "%Y-%m-%dT%H:%M:%SZ", &tm_now);
+  return str;
+}
+
+int SoapyHackRFDuplex::start_recording(const std::string &path) {
+  if (_recorder.active) this->stop_recording();
+
+  const std::string base = sigmf_base(path);
+  const std::string data_path = base + ".sigmf-data";
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  bool direct = false;
+  int fd = -1;
+#ifdef O_DIRECT
+  fd = open(data_path.c_str(), flags | O_DIRECT, 0644);
+  direct = fd >= 0;
+#endif
+  if (fd < 0) fd = open(data_path.c_str(), flags, 0644);
+  if (fd < 0) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Could not open %s -- %s",
+                  data_path.c_str(), strerror(errno));
+    return SOAPY_SDR_STREAM_ERROR;
+  }
+#ifdef F_NOCACHE
+  if (fcntl(fd, F_NOCACHE, 1) == 0) direct = true;
+#endif
+
+  bool rx_opened;
+  {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    rx_opened = _rx_stream.opened;
+    _recorder.datetime = utc_datetime();
+    _recorder.samplerate = _rx_stream.samplerate;
+    _recorder.frequency = _rx_stream.frequency;
+    _recorder.lna_gain = _rx_stream.lna_gain;
+    _recorder.vga_gain = _rx_stream.vga_gain;
+    _recorder.amp_gain = _rx_stream.amp_gain;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    _recorder.path = base;
+    _recorder.fd = fd;
+    _recorder.direct = direct;
+    _recorder.buf = (int8_t **)calloc(_recorder.buf_num, sizeof(int8_t *));
+    for (uint32_t i = 0; _recorder.buf and i < _recorder.buf_num; ++i) {
+      void *ptr = nullptr;
+      if (posix_memalign(&ptr, HACKRF_BUF_ALIGN, _rx_stream.buf_len) != 0) {
+        ptr = nullptr;
+      }
+      _recorder.buf[i] = (int8_t *)ptr;
+    }
+    _recorder.lengths.assign(_recorder.buf_num, 0);
+    _recorder.indices.assign(_recorder.buf_num, 0);
+    _recorder.head = 0;
+    _recorder.count = 0;
+    _recorder.received = 0;
+    _recorder.written = 0;
+    _recorder.next_index = 0;
+    _recorder.dropped = 0;
+    _recorder.gaps.clear();
+    _recorder.stop = false;
+  }
+  this->write_record_meta();
+
+  _recorder.writer = std::thread(&SoapyHackRFDuplex::record_writer, this);
+  _recorder.active = true;
+
+  // recording on its own runs the RX stream for the capture
+  if (not rx_opened) {
+    this->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS8);
+    _recorder.owns_rx = true;
+    int ret = this->activateStream(RX_STREAM);
+    if (ret != 0) {
+      this->stop_recording();
+      return ret;
+    }
+  }
+
+  SoapySDR_logf(SOAPY_SDR_INFO, "Recording to %s%s", data_path.c_str(),
+                direct ? " (direct I/O)" : "");
+  return 0;
+}
+
+void SoapyHackRFDuplex::stop_recording(void) {
+  if (not _recorder.writer.joinable()) return;
+
+  if (_recorder.owns_rx) {
+    this->closeStream(RX_STREAM);
+    _recorder.owns_rx = false;
+  }
+  _recorder.active = false;
+
+  {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    _recorder.stop = true;
+  }
+  _recorder.cond.notify_one();
+  _recorder.writer.join();
+
+  this->write_record_meta();
+
+  std::lock_guard<std::mutex> lock(_record_mutex);
+  close(_recorder.fd);
+  _recorder.fd = -1;
+  for (uint32_t i = 0; _recorder.buf and i < _recorder.buf_num; ++i) {
+    free(_recorder.buf[i]);
+  }
+  free(_recorder.buf);
+  _recorder.buf = nullptr;
+
+  if (_recorder.dropped > 0) {
+    SoapySDR_logf(SOAPY_SDR_WARNING,
+                  "Recording %s dropped %llu samples in %zu gap(s)",
+                  _recorder.path.c_str(),
+                  (unsigned long long)_recorder.dropped,
+                  _recorder.gaps.size());
+  }
+}
+
+void SoapyHackRFDuplex::record_push(const int8_t *buffer, int32_t length) {
+  std::lock_guard<std::mutex> lock(_record_mutex);
+  if (not _recorder.active or _recorder.buf == nullptr) return;
+
+  const uint32_t len = std::min<uint32_t>(length, _rx_stream.buf_len);
+  const uint64_t n = len / BYTES_PER_SAMPLE;
+
+  if (_recorder.count == _recorder.buf_num) {
+    // the writer is behind, drop this transfer; the writer sees the jump in
+    // index and marks the discontinuity
+    _recorder.dropped += n;
+    _recorder.received += n;
+    return;
+  }
+
+  const uint32_t slot =
+      (_recorder.head + _recorder.count) % _recorder.buf_num;
+  if (_recorder.buf[slot] == nullptr) return;
+  memcpy(_recorder.buf[slot], buffer, len);
+  _recorder.lengths[slot] = len;
+  _recorder.indices[slot] = _recorder.received;
+
+  _recorder.received += n;
+  _recorder.count++;
+  _recorder.cond.notify_one();
+}
+
+void SoapyHackRFDuplex::record_writer(void) {
+  std::unique_lock<std::mutex> lock(_record_mutex);
+  bool failed = false;
+
+  while (true) {
+    _recorder.cond.wait(
+        lock, [this] { return _recorder.count > 0 or _recorder.stop; });
+    if (_recorder.count == 0) break;
+
+    // the slot at head is owned by the writer until head moves on
+    const uint32_t slot = _recorder.head;
+    const int8_t *data = _recorder.buf[slot];
+    const uint32_t len = _recorder.lengths[slot];
+    const uint64_t index = _recorder.indices[slot];
+    lock.unlock();
+
+    if (_recorder.direct and len % HACKRF_BUF_ALIGN != 0) {
+      // a short transfer can not go through O_DIRECT, nor can any after it
+#ifdef O_DIRECT
+      fcntl(_recorder.fd, F_SETFL, fcntl(_recorder.fd, F_GETFL) & ~O_DIRECT);
+#endif
+      _recorder.direct = false;
+    }
+
+    size_t done = 0;
+    while (not failed and done < len) {
+      const ssize_t ret = write(_recorder.fd, data + done, len - done);
+      if (ret >= 0) {
+        done += ret;
+        continue;
+      }
+      if (errno == EINTR) continue;
+#ifdef O_DIRECT
+      if (errno == EINVAL and _recorder.direct) {
+        // the filesystem refused direct I/O part way, finish buffered
+        fcntl(_recorder.fd, F_SETFL,
+              fcntl(_recorder.fd, F_GETFL) & ~O_DIRECT);
+        _recorder.direct = false;
+        SoapySDR_logf(SOAPY_SDR_WARNING,
+                      "Recording falls back to buffered I/O -- %s",
+                      strerror(errno));
+        continue;
+      }
+#endif
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "Recording write failed, dropping the rest -- %s",
+                    strerror(errno));
+      failed = true;
+    }
+
+    const uint64_t samps = done / BYTES_PER_SAMPLE;
+    if (failed and done % BYTES_PER_SAMPLE != 0) {
+      // no half sample at the end of the file
+      if (ftruncate(_recorder.fd,
+                    (_recorder.written + samps) * BYTES_PER_SAMPLE) != 0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "Recording truncate failed -- %s",
+                      strerror(errno));
+      }
+    }
+
+    lock.lock();
+    _recorder.head = (_recorder.head + 1) % _recorder.buf_num;
+    _recorder.count--;
+    // whatever did not reach the file is dropped like a pool overflow
+    if (samps > 0) {
+      if (index != _recorder.next_index) {
+        _recorder.gaps.push_back(std::make_pair(_recorder.written, index));
+      }
+      _recorder.written += samps;
+      _recorder.next_index = index + samps;
+    }
+    _recorder.dropped += len / BYTES_PER_SAMPLE - samps;
+  }
+}
+
+void SoapyHackRFDuplex::write_record_meta(void) {
+  std::ostringstream meta;
+  {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    meta.precision(17);
+    meta << "{\n"
+         << "  \"global\": {\n"
+         << "    \"core:datatype\": \"ci8\",\n"
+         << "    \"core:version\": \"1.0.0\",\n"
+         << "    \"core:sample_rate\": " << _recorder.samplerate << ",\n"
+         << "    \"core:recorder\": \"SoapyHackRFDuplex\",\n"
+         << "    \"core:hw\": \"HackRF " << _rx_serial << "\",\n"
+         << "    \"hackrf:lna_gain\": " << _recorder.lna_gain << ",\n"
+         << "    \"hackrf:vga_gain\": " << _recorder.vga_gain << ",\n"
+         << "    \"hackrf:amp_gain\": " << (int)_recorder.amp_gain << "\n"
+         << "  },\n"
+         << "  \"captures\": [\n"
+         << "    {\"core:sample_start\": 0, \"core:global_index\": 0, "
+         << "\"core:frequency\": " << _recorder.frequency
+         << ", \"core:datetime\": \"" << _recorder.datetime << "\"}";
+    for (size_t i = 0; i < _recorder.gaps.size(); ++i) {
+      meta << ",\n    {\"core:sample_start\": " << _recorder.gaps[i].first
+           << ", \"core:global_index\": " << _recorder.gaps[i].second
+           << ", \"core:frequency\": " << _recorder.frequency << "}";
+    }
+    meta << "\n  ],\n  \"annotations\": [";
+    for (size_t i = 0; i < _recorder.gaps.size(); ++i) {
+      // global index minus file index is the running total dropped
+      const uint64_t prev_dropped =
+          i == 0 ? 0
+                 : _recorder.gaps[i - 1].second - _recorder.gaps[i - 1].first;
+      const uint64_t missing =
+          _recorder.gaps[i].second - _recorder.gaps[i].first - prev_dropped;
+      meta << (i ? ",\n" : "\n") << "    {\"core:sample_start\": "
+           << _recorder.gaps[i].first << ", \"core:sample_count\": 0"
+           << ", \"core:comment\": \"overflow, " << missing
+           << " samples dropped\"}";
+    }
+    meta << (_recorder.gaps.empty() ? "]\n" : "\n  ]\n") << "}\n";
+  }
+
+  const std::string meta_path = _recorder.path + ".sigmf-meta";
+  FILE *f = fopen(meta_path.c_str(), "w");
+  if (f == nullptr) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Could not write %s", meta_path.c_str());
+    return;
+  }
+  fputs(meta.str().c_str(), f);
+  fclose(f);
+}
@@ -25,7 +25,7 @@
 
 #include "SoapyHackRFDuplex.hpp"
 
-static inline std::string ltrim(std::string s, char* t)
+static inline std::string ltrim(std::string s, const char* t)
 {
     s.erase(0, s.find_first_not_of(t));
     return s;
@@ -47,10 +47,18 @@ static std::vector<SoapySDR::Kwargs> find_HackRF(const SoapySDR::Kwargs &args) {
       uint8_t board_id = BOARD_ID_INVALID;
       read_partid_serialno_t read_partid_serialno;
 
-      hackrf_device_list_open(list, i, &device);
-
       SoapySDR::Kwargs options;
 
+      // a board held by an instance in this process can not be opened
+      // again, but the list still has its serial
+      const char *listed = list->serial_numbers[i];
+      if (listed != NULL and HackRF_BoardManager::instance().claimed(listed)) {
+        options["serial"] = ltrim(listed, "0");
+        options["label"] = "#" + std::to_string(i) + " " + options["serial"] + " (claimed)";
+      } else {
+        hackrf_device_list_open(list, i, &device);
+      }
+
       if (device != NULL) {
         hackrf_board_id_read(device, &board_id);
 
@@ -87,6 +95,10 @@ static std::vector<SoapySDR::Kwargs> find_HackRF(const SoapySDR::Kwargs &args) {
                 serial_str + ofs);
         options["label"] = label_str;
 
+        hackrf_close(device);
+      }
+
+      if (options.count("serial") != 0) {
         // filter based on serial
         const bool rxMatch = args.at("rx_serial") == options["serial"] || args.at("rx_serial") == ltrim(options["serial"],"0");
         const bool txMatch = args.at("tx_serial") == options["serial"] || args.at("tx_serial") == ltrim(options["serial"],"0");
@@ -103,8 +115,6 @@ static std::vector<SoapySDR::Kwargs> find_HackRF(const SoapySDR::Kwargs &args) {
           options["version"].c_str(),
           usage.c_str()
         );
-
-        hackrf_close(device);
       }
     }
   } 
@@ -129,7 +139,7 @@ static std::vector<SoapySDR::Kwargs> find_HackRF(const SoapySDR::Kwargs &args) {
   }
 
   // fill in the cached results for claimed handles
-  // for (const auto &serial : HackRF_getClaimedSerials()) {
+  // for (const auto &serial : HackRF_BoardManager::instance().claimed_serials()) {
   //   if (_cachedResults.count(serial) == 0) continue;
   //   if (args.count("serial") != 0 and args.at("serial") != serial) continue;
   //   results.push_back(_cachedResults.at(serial));
@@ -0,0 +1,170 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+#include <cmath>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * The relay forwards every RX transfer into the TX ring from inside the RX
+ * callback, so a repeated sample only crosses the two USB transfers and, when
+ * gain or a frequency shift is set, one conversion through float. Both
+ * streams are opened by the relay itself when the application has not
+ * opened them; an application may keep reading the RX stream alongside.
+ */
+
+void SoapyHackRFDuplex::configure_relay(void) {
+  _relay.gain = (float)pow(10.0, _relay.gain_db / 20.0);
+  _relay.nco.set_frequency(_relay.offset, _tx_stream.samplerate);
+
+  // the TX ring depth bounds the added latency, at transfer granularity
+  const double buffer_us =
+      (_tx_stream.buf_len / BYTES_PER_SAMPLE) / _tx_stream.samplerate * 1e6;
+  _relay.max_buffers = _tx_stream.buf_num;
+  if (_relay.latency_us > 0 and buffer_us > 0) {
+    _relay.max_buffers = std::max<uint32_t>(
+        1, std::min<uint32_t>(_tx_stream.buf_num,
+                              (uint32_t)(_relay.latency_us / buffer_us)));
+  }
+}
+
+int SoapyHackRFDuplex::start_relay(void) {
+  if (_relay.active) return 0;
+
+  {
+    std::lock_guard<std::mutex> rx_lock(_rx_device_mutex);
+    std::lock_guard<std::mutex> tx_lock(_tx_device_mutex);
+    if (_rx_stream.samplerate <= 0 or
+        _rx_stream.samplerate != _tx_stream.samplerate) {
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "relay needs equal RX and TX board sample rates");
+      return SOAPY_SDR_NOT_SUPPORTED;
+    }
+    if (_tx_stream.opened) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "relay needs the TX stream to be closed");
+      return SOAPY_SDR_NOT_SUPPORTED;
+    }
+  }
+
+  this->setupStream(SOAPY_SDR_TX, SOAPY_SDR_CS8);
+  _relay.owns_tx = true;
+
+  bool rx_opened;
+  {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    rx_opened = _rx_stream.opened;
+  }
+  if (not rx_opened) {
+    this->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS8);
+    _relay.owns_rx = true;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    this->configure_relay();
+    _relay.forwarded = 0;
+    _relay.dropped = 0;
+    _relay.active = true;
+  }
+
+  int ret = this->activateStream(TX_STREAM);
+  if (ret == 0) ret = this->activateStream(RX_STREAM);
+  if (ret != 0) {
+    this->stop_relay();
+    return ret;
+  }
+
+  SoapySDR_logf(SOAPY_SDR_INFO, "Relay started, %u transfer(s) of latency",
+                _relay.max_buffers);
+  return 0;
+}
+
+void SoapyHackRFDuplex::stop_relay(void) {
+  {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    _relay.active = false;
+  }
+
+  if (_relay.owns_tx) {
+    this->closeStream(TX_STREAM);
+    _relay.owns_tx = false;
+  }
+  if (_relay.owns_rx) {
+    this->closeStream(RX_STREAM);
+    _relay.owns_rx = false;
+  }
+}
+
+void SoapyHackRFDuplex::relay_forward(const int8_t *buffer, int32_t length) {
+  std::lock_guard<std::mutex> relay_lock(_relay_mutex);
+  if (not _relay.active) return;
+
+  const size_t len = std::min<size_t>(length, _tx_stream.buf_len);
+  const size_t n = len / BYTES_PER_SAMPLE;
+  const bool passthrough = _relay.gain == 1.0f and not _relay.nco.enabled();
+
+  if (not passthrough) {
+    _relay.work.resize(n * BYTES_PER_SAMPLE);
+    float *work = _relay.work.data();
+    HackRF_cs8_to_cf32(buffer, work, n);
+    _relay.nco.mix(work, n);
+    const float gain = _relay.gain;
+    for (size_t i = 0; i < n * BYTES_PER_SAMPLE; ++i) {
+      work[i] *= gain;
+    }
+  }
+
+  std::unique_lock<std::mutex> lock(_tx_buf_mutex);
+
+  // over the latency budget, drop the oldest queued transfer
+  if (_tx_stream.buf_count >= _relay.max_buffers) {
+    _tx_stream.queued -=
+        _tx_stream.buf_samps[_tx_stream.buf_tail] - _tx_stream.tail_offset;
+    _tx_stream.tail_offset = 0;
+    _tx_stream.tail_burst = 0;
+    _tx_stream.buf_tail = (_tx_stream.buf_tail + 1) % _tx_stream.buf_num;
+    _tx_stream.buf_count--;
+    _relay.dropped++;
+  }
+
+  const uint32_t slot =
+      (_tx_stream.buf_tail + _tx_stream.buf_count) % _tx_stream.buf_num;
+  int8_t *dst = _tx_stream.buf[slot];
+  if (passthrough) {
+    memcpy(dst, buffer, len);
+  } else {
+    HackRF_cf32_to_cs8(_relay.work.data(), dst, n);
+  }
+  if (len < _tx_stream.buf_len) {
+    memset(dst + len, 0, _tx_stream.buf_len - len);
+  }
+
+  _tx_stream.buf_samps[slot] = _tx_stream.buf_len / BYTES_PER_SAMPLE;
+  _tx_stream.buf_burst_ends[slot].clear();
+  _tx_stream.queued += _tx_stream.buf_samps[slot];
+  _tx_stream.buf_count++;
+  _tx_stream.buf_head = (slot + 1) % _tx_stream.buf_num;
+  _relay.forwarded++;
+  _tx_buf_cond.notify_one();
+}
@@ -0,0 +1,143 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+#include <cstdlib>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * Adaptive RX ring depth. The RX callback watches how full the ring gets
+ * and picks a new depth; the reader applies it, since that is the thread
+ * that can afford to allocate and the one whose slot handles would move.
+ * The ring grows by half on an overflow or when a window peaks above three
+ * quarters full, and gives back a quarter for every window that stays below
+ * a quarter full, so one quiet spell does not undo what jitter needed.
+ */
+
+void SoapyHackRFDuplex::track_rx_depth(const bool overflowed) {
+  RXStream &s = _rx_stream;
+  if (s.buf_max <= s.buf_min) return;
+
+  s.window_count++;
+  s.window_peak = std::max(s.window_peak, s.buf_count + s.history_pending);
+
+  // one resize at a time, the reader may not have applied the last one
+  if (s.buf_target != s.buf_num) return;
+
+  const uint32_t grown =
+      std::min(s.buf_max, s.buf_num + std::max<uint32_t>(s.buf_num / 2, 1));
+  if (overflowed and s.buf_num < s.buf_max) {
+    s.buf_target = grown;
+    s.target_reason = "overflow";
+  } else if (s.window_count < HACKRF_RING_WINDOW) {
+    return;
+  } else if (s.window_peak * 4 >= s.buf_num * 3 and s.buf_num < s.buf_max) {
+    s.buf_target = grown;
+    s.target_reason = "consumer lag";
+  } else if (s.window_peak * 4 < s.buf_num and s.buf_num > s.buf_min) {
+    s.buf_target = std::max(s.buf_min, s.buf_num - std::max(s.buf_num / 4, 1u));
+    s.target_reason = "idle";
+  }
+  s.window_count = 0;
+  s.window_peak = 0;
+}
+
+void SoapyHackRFDuplex::resize_rx_ring(void) {
+  uint32_t num = 0;
+  uint32_t target = 0;
+  {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    if (_rx_stream.buf_target == _rx_stream.buf_num or
+        _rx_stream.buf_held > 0 or _rx_stream.buf == nullptr) {
+      return;
+    }
+    num = _rx_stream.buf_num;
+    target = _rx_stream.buf_target;
+  }
+
+  // allocate outside the lock so the callback is not held up
+  std::vector<int8_t *> fresh;
+  for (uint32_t i = num; i < target; ++i) {
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, HACKRF_BUF_ALIGN, _rx_stream.buf_len) != 0) break;
+    fresh.push_back((int8_t *)ptr);
+  }
+  int8_t **buf = (int8_t **)malloc(std::max(num, target) * sizeof(int8_t *));
+  std::vector<int8_t *> stale;
+
+  {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    RXStream &s = _rx_stream;
+    if (buf != nullptr and s.buf_num == num and s.buf_held == 0) {
+      // the ring is laid out again from buf_head, queued and history slots
+      // first, and never cut below what they occupy
+      const uint32_t used = s.buf_count + s.history_pending;
+      const uint32_t depth =
+          std::max(used, std::min(target, num + (uint32_t)fresh.size()));
+
+      std::vector<uint32_t> samps(depth, s.buf_len / BYTES_PER_SAMPLE);
+      std::vector<uint64_t> index(depth, 0);
+      std::vector<long long> time(depth, 0);
+      std::vector<uint8_t> burst_end(depth, 0);
+      for (uint32_t i = 0; i < num; ++i) {
+        const uint32_t slot = (s.buf_head + i) % num;
+        if (i >= depth) {
+          stale.push_back(s.buf[slot]);
+          continue;
+        }
+        buf[i] = s.buf[slot];
+        samps[i] = s.buf_samps[slot];
+        index[i] = s.buf_index[slot];
+        time[i] = s.buf_time[slot];
+        burst_end[i] = s.buf_burst_end[slot];
+      }
+      for (uint32_t i = num; i < depth; ++i) buf[i] = fresh[i - num];
+      fresh.erase(fresh.begin(),
+                  fresh.begin() + (depth > num ? depth - num : 0));
+
+      std::swap(s.buf, buf);
+      s.buf_samps.swap(samps);
+      s.buf_index.swap(index);
+      s.buf_time.swap(time);
+      s.buf_burst_end.swap(burst_end);
+      s.buf_head = 0;
+      s.buf_tail = 0;
+      s.buf_num = depth;
+      s.buf_target = depth;
+      s.window_count = 0;
+      s.window_peak = 0;
+      this->unspill_rx();
+
+      if (s.resizes.size() == HACKRF_RING_RESIZES) s.resizes.pop_front();
+      s.resizes.push_back(std::to_string(num) + "->" + std::to_string(depth) +
+                          " " + s.target_reason);
+      SoapySDR_logf(SOAPY_SDR_DEBUG, "RX ring %u -> %u buffers, %s", num,
+                    depth, s.target_reason.c_str());
+    }
+  }
+
+  // whichever pointer array is not in use now, and any unused buffers
+  free(buf);
+  for (size_t i = 0; i < fresh.size(); ++i) free(fresh[i]);
+  for (size_t i = 0; i < stale.size(); ++i) free(stale[i]);
+}
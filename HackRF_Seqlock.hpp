@@ -0,0 +1,86 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <mutex>
+
+/*!
+ * Sequence lock publishing a trivially copyable T. Readers copy the value
+ * out without taking a lock and retry only if a store overlapped the copy;
+ * stores are a few word writes, so a reader never waits behind anything
+ * slower. The value is held as relaxed atomic words so the overlapping
+ * copy is not a data race.
+ */
+template <typename T>
+class HackRF_Seqlock {
+ public:
+  HackRF_Seqlock(void) : _seq(0), _shadow() { this->store(_shadow); }
+
+  /// Apply modify to the current value and publish the result
+  template <typename F>
+  void update(F modify) {
+    std::lock_guard<std::mutex> lock(_write);
+    modify(_shadow);
+    this->store(_shadow);
+  }
+
+  T load(void) const {
+    uint64_t words[WORDS];
+    uint32_t before, after;
+    do {
+      before = _seq.load(std::memory_order_acquire);
+      for (size_t i = 0; i < WORDS; ++i) {
+        words[i] = _data[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = _seq.load(std::memory_order_relaxed);
+    } while (before != after or (before & 1) != 0);
+
+    T value;
+    memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+ private:
+  static const size_t WORDS = (sizeof(T) + 7) / 8;
+
+  void store(const T &value) {
+    uint64_t words[WORDS] = {};
+    memcpy(words, &value, sizeof(T));
+    const uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; ++i) {
+      _data[i].store(words[i], std::memory_order_relaxed);
+    }
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  std::atomic<uint32_t> _seq;
+  std::atomic<uint64_t> _data[WORDS];
+  std::mutex _write;
+  T _shadow;  // the writers' copy, guarded by _write
+};
@@ -24,11 +24,30 @@
 
 #include "SoapyHackRFDuplex.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-
-std::set<std::string> &HackRF_getClaimedSerials(void) {
-  static std::set<std::string> serials;
-  return serials;
+#include <sstream>
+
+/// Parse a CPU list such as "2,3" or "4-7", false if it is malformed
+static bool HackRF_parseCpus(const std::string &value, std::vector<int> &cpus) {
+  cpus.clear();
+  std::stringstream ss(value);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) continue;
+    try {
+      const size_t dash = item.find('-');
+      const int first = std::stoi(item.substr(0, dash));
+      const int last =
+          dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+      if (first < 0 or last < first) return false;
+      for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  return true;
 }
 
 SoapyHackRFDuplex::SoapyHackRFDuplex(const SoapySDR::Kwargs &args) {
@@ -41,15 +60,75 @@ SoapyHackRFDuplex::SoapyHackRFDuplex(const SoapySDR::Kwargs &args) {
   _rx_stream.samplerate = 0;
   _rx_stream.bandwidth = 0;
   _rx_stream.overflow = false;
+  _rx_stream.overflow_policy = HACKRF_OVERFLOW_DROP_OLDEST;
+  _rx_stream.overflow_time = 0;
+  _rx_stream.gap_index = 0;
+  _rx_stream.gap_samps = 0;
+  _rx_stream.gap_time = 0;
+  _rx_stream.samples_lost = 0;
+  _rx_stream.dsp_dirty = true;
+  _rx_stream.dsp_active = false;
+  _rx_stream.dsp_wanted = false;
+  _rx_stream.dsp_samps = 0;
+  _rx_stream.dsp_offset = 0;
+  _rx_stream.dsp_time = 0;
+  _rx_stream.dsp_rate = 0.0;
+  _rx_stream.dsp_index = 0;
+  _rx_stream.dsp_burst_end = false;
+  _rx_stream.dsp_gap = false;
+  _rx_stream.buf_held = 0;
+  _rx_stream.sample_index = 0;
+  _rx_stream.start_time_ns = 0;
+  _rx_stream.remainder_index = 0;
+  _rx_stream.remainder_time = 0;
+  _rx_stream.remainder_burst_end = false;
+  _rx_stream.squelch = false;
+  _rx_stream.squelch_threshold_db = -40.0;
+  _rx_stream.squelch_threshold = 1e-4f;
+  _rx_stream.squelch_pre = 1;
+  _rx_stream.squelch_post = 1;
+  _rx_stream.history_pending = 0;
+  _rx_stream.squelch_hold = 0;
+  _rx_stream.squelch_open = false;
+  _rx_stream.buf_min = 2;
+  _rx_stream.buf_max = 0;
+  _rx_stream.buf_target = BUF_NUM;
+  _rx_stream.window_count = 0;
+  _rx_stream.window_peak = 0;
+  _rx_stream.acq = false;
+  _rx_stream.acq_pre = 0;
+  _rx_stream.acq_start = 0;
+  _rx_stream.acq_end = 0;
+  _rx_stream.acq_limit = false;
+  _rx_stream.acq_left = 0;
+  _rx_stream.acq_discard = false;
 
   _tx_stream.vga_gain = 0;
   _tx_stream.amp_gain = 0;
   _tx_stream.frequency = 0;
   _tx_stream.samplerate = 0;
   _tx_stream.bandwidth = 0;
-  _tx_stream.burst_samps = 0;
-  _tx_stream.burst_end = false;
+  _tx_stream.in_gap = false;
+  _tx_stream.tail_offset = 0;
+  _tx_stream.tail_burst = 0;
+  _tx_stream.flush_pending = false;
+  _tx_stream.latency_us = 0;
+  _tx_stream.queued = 0;
+  _tx_stream.granted = 0;
+  _tx_stream.dropped = 0;
+  _tx_stream.dsp_burst_end = false;
+  _tx_stream.cyclic = false;
+  _tx_stream.preroll = 0;
+  _tx_stream.start_pending = false;
+  _tx_stream.start_time_ns = 0;
   _tx_stream.underflow = false;
+  _tx_stream.user_rate = 0;
+  _tx_stream.interp = 1;
+  _tx_stream.ratio = 1.0;
+  _tx_stream.dsp_dirty = true;
+  _tx_stream.dsp_active = false;
+  _tx_stream.dsp_wanted = false;
+  _tx_stream.offset = 0.0;
 
   _rx_active = HACKRF_TRANSCEIVER_MODE_OFF;
   _tx_active = HACKRF_TRANSCEIVER_MODE_OFF;
@@ -71,6 +150,19 @@ SoapyHackRFDuplex::SoapyHackRFDuplex(const SoapySDR::Kwargs &args) {
   _rx_serial = args.at("rx_serial");
   _tx_serial = args.at("tx_serial");
 
+  _rx_num_channels = 1;
+  if (args.count("rx_channels") != 0) {
+    try {
+      int channels_in = std::stoi(args.at("rx_channels"));
+      if (channels_in > 0 and channels_in <= HACKRF_MAX_RX_CHANNELS) {
+        _rx_num_channels = channels_in;
+      }
+    } catch (const std::invalid_argument &) {
+    }
+  }
+  _rx_stream.channels.resize(_rx_num_channels);
+  this->plan_rx_channels();
+
   _tx_current_amp = 0;
   _rx_current_amp = 0;
 
@@ -83,33 +175,72 @@ SoapyHackRFDuplex::SoapyHackRFDuplex(const SoapySDR::Kwargs &args) {
   _rx_current_bandwidth = 0;
   _tx_current_bandwidth = 0;
 
+  this->publish_device_config(SOAPY_SDR_RX);
+  this->publish_device_config(SOAPY_SDR_TX);
+  this->publish_dsp_config(SOAPY_SDR_TX);
+
+  _control_issued = 0;
+  _control_errors = 0;
+
+  // transfer thread placement is shared by every board in the process
+  if (args.count("callback_cpus") != 0) {
+    std::vector<int> cpus;
+    if (not HackRF_parseCpus(args.at("callback_cpus"), cpus))
+      throw std::runtime_error("invalid callback_cpus");
+    HackRF_BoardManager::instance().set_callback_cpus(cpus);
+  }
+
+  // claimed before opening, so two instances can not race for a board
+  HackRF_BoardManager &boards = HackRF_BoardManager::instance();
+  if (not boards.claim(_rx_serial))
+    throw std::runtime_error("HackRF " + _rx_serial + " already in use");
+  if (not boards.claim(_tx_serial)) {
+    boards.release(_rx_serial);
+    throw std::runtime_error("HackRF " + _tx_serial + " already in use");
+  }
+
   SoapySDR_logf(SOAPY_SDR_DEBUG, "Opening Devices...");
 
   int ret = hackrf_open_by_serial(_rx_serial.c_str(), &_rx_dev);
   if (ret != HACKRF_SUCCESS) {
     SoapySDR_logf(SOAPY_SDR_ERROR, "Could not Open HackRF RX Device");
+    boards.release(_rx_serial);
+    boards.release(_tx_serial);
     throw std::runtime_error("hackrf open failed");
   }
 
   ret = hackrf_open_by_serial(_tx_serial.c_str(), &_tx_dev);
   if (ret != HACKRF_SUCCESS) {
     SoapySDR_logf(SOAPY_SDR_ERROR, "Could not Open HackRF TX Device");
+    hackrf_close(_rx_dev);
+    boards.release(_rx_serial);
+    boards.release(_tx_serial);
     throw std::runtime_error("hackrf open failed");
   }
 
   SoapySDR_logf(SOAPY_SDR_DEBUG, "Opened Devices");
 
-  HackRF_getClaimedSerials().insert(_rx_serial);
-  HackRF_getClaimedSerials().insert(_tx_serial);
+  if (args.count("async_control") != 0 and args.at("async_control") == "true")
+    this->start_control();
 }
 
 SoapyHackRFDuplex::~SoapyHackRFDuplex(void) {
-  HackRF_getClaimedSerials().erase(_rx_serial);
-  HackRF_getClaimedSerials().erase(_tx_serial);
+  // queued control writes are applied before anything is torn down
+  this->stop_control();
+  this->stop_relay();
+  this->stop_recording();
+  this->stop_playback();
+  this->stop_spectrum();
+  this->stop_preamble();
+  this->stop_stream_worker(RX_STREAM);
+  this->stop_stream_worker(TX_STREAM);
 
   /* cleanup device handles */
   if (_rx_dev) hackrf_close(_rx_dev);
   if (_tx_dev) hackrf_close(_tx_dev);
+
+  HackRF_BoardManager::instance().release(_rx_serial);
+  HackRF_BoardManager::instance().release(_tx_serial);
   std::cout << "Closed Devices\n";
 }
 
@@ -180,7 +311,10 @@ SoapySDR::Kwargs SoapyHackRFDuplex::getHardwareInfo(void) const {
  * Channels API
  ******************************************************************/
 
-size_t SoapyHackRFDuplex::getNumChannels(const int dir) const { return (1); }
+size_t SoapyHackRFDuplex::getNumChannels(const int dir) const {
+  if (dir == SOAPY_SDR_RX) return (_rx_num_channels);
+  return (1);
+}
 
 bool SoapyHackRFDuplex::getFullDuplex(const int direction,
                                       const size_t channel) const {
@@ -202,24 +336,867 @@ SoapySDR::ArgInfoList SoapyHackRFDuplex::getSettingInfo(void) const {
   biastxArg.type = SoapySDR::ArgInfo::BOOL;
   setArgs.push_back(biastxArg);
 
+  SoapySDR::ArgInfo asyncControlArg;
+  asyncControlArg.key = "async_control";
+  asyncControlArg.value = "false";
+  asyncControlArg.name = "Async Control";
+  asyncControlArg.description =
+      "Frequency, gain, bandwidth and bias_tx writes return at once and are "
+      "applied in order by a control thread per board, a write replacing a "
+      "queued one to the same parameter. Getters report applied values. "
+      "control_issued reads the number of the last write, control_completed "
+      "how far they are applied, and writing control_wait with a number, "
+      "or empty for all, waits for them.";
+  asyncControlArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(asyncControlArg);
+
+  SoapySDR::ArgInfo callbackCpusArg;
+  callbackCpusArg.key = "callback_cpus";
+  callbackCpusArg.value = "";
+  callbackCpusArg.name = "Transfer Thread CPUs";
+  callbackCpusArg.description =
+      "CPUs such as \"2,3\" or \"2-3\" that the USB transfer threads of all "
+      "boards in the process are pinned to in turn, empty for none. Shared "
+      "by every instance, see also the claimed_boards setting.";
+  callbackCpusArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(callbackCpusArg);
+
+  SoapySDR::ArgInfo rxChannelsArg;
+  rxChannelsArg.key = "rx_channels";
+  rxChannelsArg.value = "1";
+  rxChannelsArg.name = "RX Channels";
+  rxChannelsArg.description =
+      "Number of virtual RX channels served by the channelizer. Each channel "
+      "has its own BB frequency offset and decimated sample rate. Only "
+      "changeable while the RX stream is closed.";
+  rxChannelsArg.type = SoapySDR::ArgInfo::INT;
+  rxChannelsArg.range = SoapySDR::Range(1, HACKRF_MAX_RX_CHANNELS);
+  setArgs.push_back(rxChannelsArg);
+
+  SoapySDR::ArgInfo rxChannelizerRateArg;
+  rxChannelizerRateArg.key = "rx_channelizer_rate";
+  rxChannelizerRateArg.value = "0";
+  rxChannelizerRateArg.name = "RX Channelizer Rate";
+  rxChannelizerRateArg.description =
+      "Board sample rate used when more than one RX channel is configured.";
+  rxChannelizerRateArg.units = "Sps";
+  rxChannelizerRateArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(rxChannelizerRateArg);
+
+  SoapySDR::ArgInfo relayArg;
+  relayArg.key = "relay";
+  relayArg.value = "false";
+  relayArg.name = "RX to TX Relay";
+  relayArg.description =
+      "Forward RX transfers straight into the TX ring inside the driver. "
+      "Needs equal RX and TX sample rates and the TX stream closed.";
+  relayArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(relayArg);
+
+  SoapySDR::ArgInfo relayGainArg;
+  relayGainArg.key = "relay_gain";
+  relayGainArg.value = "0";
+  relayGainArg.name = "Relay Gain";
+  relayGainArg.description = "Digital gain applied to relayed samples.";
+  relayGainArg.units = "dB";
+  relayGainArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(relayGainArg);
+
+  SoapySDR::ArgInfo relayOffsetArg;
+  relayOffsetArg.key = "relay_offset";
+  relayOffsetArg.value = "0";
+  relayOffsetArg.name = "Relay Frequency Shift";
+  relayOffsetArg.description = "NCO shift applied to relayed samples.";
+  relayOffsetArg.units = "Hz";
+  relayOffsetArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(relayOffsetArg);
+
+  SoapySDR::ArgInfo relayLatencyArg;
+  relayLatencyArg.key = "relay_latency_us";
+  relayLatencyArg.value = "0";
+  relayLatencyArg.name = "Relay Latency Target";
+  relayLatencyArg.description =
+      "Most TX queueing the relay allows before dropping the oldest "
+      "transfer, rounded down to whole transfers. 0 uses the full ring.";
+  relayLatencyArg.units = "us";
+  relayLatencyArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(relayLatencyArg);
+
+  SoapySDR::ArgInfo recordPathArg;
+  recordPathArg.key = "record_path";
+  recordPathArg.value = "";
+  recordPathArg.name = "Record Path";
+  recordPathArg.description =
+      "Write the raw RX capture to this SigMF dataset (.sigmf-data and "
+      ".sigmf-meta). An empty path stops recording.";
+  recordPathArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(recordPathArg);
+
+  SoapySDR::ArgInfo recordBuffersArg;
+  recordBuffersArg.key = "record_buffers";
+  recordBuffersArg.value = std::to_string(HACKRF_RECORD_BUF_NUM);
+  recordBuffersArg.name = "Record Buffers";
+  recordBuffersArg.description =
+      "Transfers the recorder can queue for the disk before dropping. "
+      "Applies to the next recording.";
+  recordBuffersArg.units = "buffers";
+  recordBuffersArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(recordBuffersArg);
+
+  SoapySDR::ArgInfo playbackPathArg;
+  playbackPathArg.key = "playback_path";
+  playbackPathArg.value = "";
+  playbackPathArg.name = "Playback Path";
+  playbackPathArg.description =
+      "Transmit a CS8 file or ci8 SigMF dataset straight from a memory "
+      "mapping. Needs the TX stream closed. An empty path stops playback.";
+  playbackPathArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(playbackPathArg);
+
+  SoapySDR::ArgInfo playbackLoopArg;
+  playbackLoopArg.key = "playback_loop";
+  playbackLoopArg.value = "false";
+  playbackLoopArg.name = "Playback Loop";
+  playbackLoopArg.description =
+      "Restart from the beginning of the file, not the start offset, at the "
+      "end.";
+  playbackLoopArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(playbackLoopArg);
+
+  SoapySDR::ArgInfo playbackOffsetArg;
+  playbackOffsetArg.key = "playback_offset";
+  playbackOffsetArg.value = "0";
+  playbackOffsetArg.name = "Playback Start Offset";
+  playbackOffsetArg.description = "Sample to start the next playback from.";
+  playbackOffsetArg.units = "samples";
+  playbackOffsetArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(playbackOffsetArg);
+
+  SoapySDR::ArgInfo playbackRateCheckArg;
+  playbackRateCheckArg.key = "playback_rate_check";
+  playbackRateCheckArg.value = "true";
+  playbackRateCheckArg.name = "Playback Rate Check";
+  playbackRateCheckArg.description =
+      "Refuse a SigMF dataset whose sample rate differs from the TX rate. "
+      "When false a mismatch is only logged.";
+  playbackRateCheckArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(playbackRateCheckArg);
+
+  SoapySDR::ArgInfo waveformArg;
+  waveformArg.key = "tx_waveform";
+  waveformArg.value = "0";
+  waveformArg.name = "TX Waveform";
+  waveformArg.description =
+      "Stored waveform looped by a cyclic TX stream. A new selection starts "
+      "when the current waveform wraps.";
+  waveformArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(waveformArg);
+
+  SoapySDR::ArgInfo waveformUploadArg;
+  waveformUploadArg.key = "tx_waveform_upload";
+  waveformUploadArg.value = "0";
+  waveformUploadArg.name = "TX Waveform Upload";
+  waveformUploadArg.description =
+      "Waveform id the next cyclic writeStream upload is stored under.";
+  waveformUploadArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(waveformUploadArg);
+
+  SoapySDR::ArgInfo waveformClearArg;
+  waveformClearArg.key = "tx_waveform_clear";
+  waveformClearArg.value = "";
+  waveformClearArg.name = "TX Waveform Clear";
+  waveformClearArg.description =
+      "Remove a stored waveform, or all of them with \"all\".";
+  waveformClearArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(waveformClearArg);
+
+  SoapySDR::ArgInfo spectrumArg;
+  spectrumArg.key = "spectrum";
+  spectrumArg.value = "false";
+  spectrumArg.name = "Spectrum Monitor";
+  spectrumArg.description =
+      "Compute averaged power bins from a few RX transfers a second, read "
+      "through the spectrum sensor. Opens the RX stream if needed.";
+  spectrumArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(spectrumArg);
+
+  SoapySDR::ArgInfo spectrumSizeArg;
+  spectrumSizeArg.key = "spectrum_size";
+  spectrumSizeArg.value = "1024";
+  spectrumSizeArg.name = "Spectrum FFT Size";
+  spectrumSizeArg.description =
+      "Bins per spectrum, rounded up to a power of two.";
+  spectrumSizeArg.type = SoapySDR::ArgInfo::INT;
+  spectrumSizeArg.range = SoapySDR::Range(HACKRF_SPECTRUM_MIN_SIZE,
+                                          HACKRF_SPECTRUM_MAX_SIZE);
+  setArgs.push_back(spectrumSizeArg);
+
+  SoapySDR::ArgInfo spectrumAveragesArg;
+  spectrumAveragesArg.key = "spectrum_averages";
+  spectrumAveragesArg.value = "8";
+  spectrumAveragesArg.name = "Spectrum Averages";
+  spectrumAveragesArg.description =
+      "Consecutive FFT frames averaged into each spectrum.";
+  spectrumAveragesArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(spectrumAveragesArg);
+
+  SoapySDR::ArgInfo spectrumRateArg;
+  spectrumRateArg.key = "spectrum_rate";
+  spectrumRateArg.value = "4";
+  spectrumRateArg.name = "Spectrum Update Rate";
+  spectrumRateArg.description = "Spectrum updates per second.";
+  spectrumRateArg.units = "Hz";
+  spectrumRateArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(spectrumRateArg);
+
+  SoapySDR::ArgInfo squelchArg;
+  squelchArg.key = "squelch";
+  squelchArg.value = "false";
+  squelchArg.name = "RX Squelch";
+  squelchArg.description =
+      "Only deliver RX transfers whose power reaches squelch_threshold, "
+      "with squelch_pre transfers before and squelch_post after. Buffers "
+      "carry their time, the last of each burst END_BURST.";
+  squelchArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(squelchArg);
+
+  SoapySDR::ArgInfo squelchThresholdArg;
+  squelchThresholdArg.key = "squelch_threshold";
+  squelchThresholdArg.value = "-40";
+  squelchThresholdArg.name = "RX Squelch Threshold";
+  squelchThresholdArg.description =
+      "Mean transfer power that opens the squelch, relative to a full "
+      "scale tone.";
+  squelchThresholdArg.units = "dBFS";
+  squelchThresholdArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(squelchThresholdArg);
+
+  SoapySDR::ArgInfo squelchPreArg;
+  squelchPreArg.key = "squelch_pre";
+  squelchPreArg.value = "1";
+  squelchPreArg.name = "RX Squelch Pre-trigger";
+  squelchPreArg.description =
+      "Transfers before the trigger delivered with it.";
+  squelchPreArg.units = "transfers";
+  squelchPreArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(squelchPreArg);
+
+  SoapySDR::ArgInfo squelchPostArg;
+  squelchPostArg.key = "squelch_post";
+  squelchPostArg.value = "1";
+  squelchPostArg.name = "RX Squelch Hang";
+  squelchPostArg.description =
+      "Transfers delivered after the power drops below the threshold.";
+  squelchPostArg.units = "transfers";
+  squelchPostArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(squelchPostArg);
+
+  SoapySDR::ArgInfo txFlushArg;
+  txFlushArg.key = "tx_flush";
+  txFlushArg.value = "";
+  txFlushArg.name = "TX Flush";
+  txFlushArg.description =
+      "Drop the TX data queued and not yet sent, any value. Bursts dropped "
+      "are reported END_ABRUPT by readStreamStatus. Write it from the thread "
+      "that writes the stream.";
+  txFlushArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(txFlushArg);
+
+  SoapySDR::ArgInfo acquirePreArg;
+  acquirePreArg.key = "acquire_pre";
+  acquirePreArg.value = "0";
+  acquirePreArg.name = "RX Acquisition History";
+  acquirePreArg.description =
+      "Samples before the trigger included in a finite acquisition, "
+      "activateStream() with END_BURST and numElems.";
+  acquirePreArg.units = "samples";
+  acquirePreArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(acquirePreArg);
+
+  SoapySDR::ArgInfo preambleArg;
+  preambleArg.key = "preamble";
+  preambleArg.value = "false";
+  preambleArg.name = "RX Preamble Detector";
+  preambleArg.description =
+      "Correlate RX against preamble_reference in the driver and deliver "
+      "only a window around each detection, one timed burst per window.";
+  preambleArg.type = SoapySDR::ArgInfo::BOOL;
+  setArgs.push_back(preambleArg);
+
+  SoapySDR::ArgInfo preambleReferenceArg;
+  preambleReferenceArg.key = "preamble_reference";
+  preambleReferenceArg.value = "";
+  preambleReferenceArg.name = "RX Preamble Reference";
+  preambleReferenceArg.description =
+      "Comma separated I,Q pairs of the preamble at the board sample rate.";
+  preambleReferenceArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(preambleReferenceArg);
+
+  SoapySDR::ArgInfo preambleThresholdArg;
+  preambleThresholdArg.key = "preamble_threshold";
+  preambleThresholdArg.value = "0.5";
+  preambleThresholdArg.name = "RX Preamble Threshold";
+  preambleThresholdArg.description =
+      "Normalised correlation that counts as a detection, 1.0 for an exact "
+      "copy of the reference.";
+  preambleThresholdArg.range = SoapySDR::Range(0.0, 1.0);
+  preambleThresholdArg.type = SoapySDR::ArgInfo::FLOAT;
+  setArgs.push_back(preambleThresholdArg);
+
+  SoapySDR::ArgInfo preamblePreArg;
+  preamblePreArg.key = "preamble_pre";
+  preamblePreArg.value = "1024";
+  preamblePreArg.name = "RX Preamble Pre-trigger";
+  preamblePreArg.description =
+      "Samples before the start of the preamble delivered in the window.";
+  preamblePreArg.units = "samples";
+  preamblePreArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(preamblePreArg);
+
+  SoapySDR::ArgInfo preamblePostArg;
+  preamblePostArg.key = "preamble_post";
+  preamblePostArg.value = "16384";
+  preamblePostArg.name = "RX Preamble Window";
+  preamblePostArg.description =
+      "Samples from the start of the preamble delivered in the window.";
+  preamblePostArg.units = "samples";
+  preamblePostArg.type = SoapySDR::ArgInfo::INT;
+  setArgs.push_back(preamblePostArg);
+
+  SoapySDR::ArgInfo rxCallbackArg;
+  rxCallbackArg.key = "rx_callback";
+  rxCallbackArg.value = "";
+  rxCallbackArg.name = "RX Callback";
+  rxCallbackArg.description =
+      "Push model RX callback, formatted by SoapyHackRFDuplex_callbackArg() "
+      "from SoapyHackRFDuplexCallbacks.hpp. Empty removes it.";
+  rxCallbackArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(rxCallbackArg);
+
+  SoapySDR::ArgInfo txCallbackArg;
+  txCallbackArg.key = "tx_callback";
+  txCallbackArg.value = "";
+  txCallbackArg.name = "TX Callback";
+  txCallbackArg.description =
+      "Pull model TX callback, formatted by SoapyHackRFDuplex_callbackArg() "
+      "from SoapyHackRFDuplexCallbacks.hpp. Empty removes it.";
+  txCallbackArg.type = SoapySDR::ArgInfo::STRING;
+  setArgs.push_back(txCallbackArg);
+
   return setArgs;
 }
 
 void SoapyHackRFDuplex::writeSetting(const std::string &key,
                                      const std::string &value) {
   if (key == "bias_tx") {
+    if (this->defer_control(SOAPY_SDR_TX, key, [=] {
+          this->writeSetting(key, value);
+        })) {
+      return;
+    }
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
     _tx_stream.bias = (value == "true") ? true : false;
     int ret = hackrf_set_antenna_enable(_tx_dev, _tx_stream.bias);
     if (ret != HACKRF_SUCCESS) {
       SoapySDR_logf(SOAPY_SDR_INFO, "Failed to apply antenna bias voltage");
     }
+  } else if (key == "rx_channels") {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    if (_rx_stream.opened) {
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "rx_channels can not be changed while RX stream is open");
+      return;
+    }
+    int channels_in = 0;
+    try {
+      channels_in = std::stoi(value);
+    } catch (const std::invalid_argument &) {
+    }
+    if (channels_in <= 0 or channels_in > HACKRF_MAX_RX_CHANNELS) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "rx_channels %s out of range",
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+    _rx_num_channels = channels_in;
+    _rx_stream.channels.resize(_rx_num_channels);
+    this->plan_rx_channels();
+  } else if (key == "rx_channelizer_rate") {
+    double rate = 0.0;
+    try {
+      rate = std::stod(value);
+    } catch (const std::exception &) {
+    }
+    if (rate < HACKRF_MIN_SAMPLE_RATE or rate > HACKRF_MAX_SAMPLE_RATE) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "rx_channelizer_rate %s out of range",
+                    value.c_str());
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    {
+      // a channel can only be decimated down from the board rate
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      for (size_t i = 0; i < _rx_stream.channels.size(); ++i) {
+        if (_rx_stream.channels[i].user_rate > rate) {
+          SoapySDR_logf(SOAPY_SDR_ERROR,
+                        "rx_channelizer_rate %s is below channel %zu "
+                        "rate %f",
+                        value.c_str(), i, _rx_stream.channels[i].user_rate);
+          return;
+        }
+      }
+    }
+    try {
+      this->set_rx_board_rate(rate);
+    } catch (const std::exception &) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "rx_channelizer_rate %s failed",
+                    value.c_str());
+    }
+  } else if (key == "relay") {
+    if (value == "true") {
+      this->start_relay();
+    } else {
+      this->stop_relay();
+    }
+  } else if (key == "relay_gain" or key == "relay_offset" or
+             key == "relay_latency_us") {
+    double value_in = 0.0;
+    try {
+      value_in = std::stod(value);
+    } catch (const std::exception &) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    if (key == "relay_gain") {
+      _relay.gain_db = value_in;
+    } else if (key == "relay_offset") {
+      _relay.offset = value_in;
+    } else {
+      _relay.latency_us = std::max(0L, (long)value_in);
+    }
+    if (_relay.active) this->configure_relay();
+  } else if (key == "record_path") {
+    if (value.empty()) {
+      this->stop_recording();
+    } else {
+      this->start_recording(value);
+    }
+  } else if (key == "record_buffers") {
+    int buffers_in = 0;
+    try {
+      buffers_in = std::stoi(value);
+    } catch (const std::exception &) {
+    }
+    if (buffers_in <= 0) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "record_buffers %s invalid",
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    if (_recorder.buf == nullptr) _recorder.buf_num = buffers_in;
+  } else if (key == "playback_path") {
+    if (value.empty()) {
+      this->stop_playback();
+    } else {
+      this->start_playback(value);
+    }
+  } else if (key == "playback_loop") {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    _playback.loop = value == "true";
+  } else if (key == "playback_rate_check") {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    _playback.rate_check = value == "true";
+  } else if (key == "playback_offset") {
+    long long offset_in = -1;
+    try {
+      offset_in = std::stoll(value);
+    } catch (const std::exception &) {
+    }
+    if (offset_in < 0) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "playback_offset %s invalid",
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    _playback.offset = offset_in;
+  } else if (key == "tx_waveform" or key == "tx_waveform_upload" or
+             (key == "tx_waveform_clear" and value != "all")) {
+    int id = -1;
+    try {
+      id = std::stoi(value);
+    } catch (const std::exception &) {
+    }
+    if (id < 0) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    if (key == "tx_waveform") {
+      if (_waveforms.waveforms.count(id) == 0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "No TX waveform %d stored", id);
+        return;
+      }
+      _waveforms.next = id;
+      if (_waveforms.current < 0 or
+          _waveforms.waveforms.count(_waveforms.current) == 0) {
+        _waveforms.current = id;
+        _waveforms.pos = 0;
+      }
+    } else if (key == "tx_waveform_upload") {
+      _waveforms.upload_id = id;
+      _waveforms.upload_restart = true;
+    } else {
+      _waveforms.waveforms.erase(id);
+    }
+  } else if (key == "tx_waveform_clear") {
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    _waveforms.waveforms.clear();
+    _waveforms.current = -1;
+    _waveforms.next = -1;
+    _waveforms.pos = 0;
+  } else if (key == "spectrum") {
+    if (value == "true") {
+      this->start_spectrum();
+    } else {
+      this->stop_spectrum();
+    }
+  } else if (key == "spectrum_size" or key == "spectrum_averages" or
+             key == "spectrum_rate") {
+    double value_in = 0.0;
+    try {
+      value_in = std::stod(value);
+    } catch (const std::exception &) {
+    }
+    if (value_in <= 0.0) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    if (key == "spectrum_size") {
+      size_t size = HACKRF_SPECTRUM_MIN_SIZE;
+      while (size < value_in and size < HACKRF_SPECTRUM_MAX_SIZE) size *= 2;
+      _spectrum.size = size;
+    } else if (key == "spectrum_averages") {
+      _spectrum.averages = (size_t)value_in;
+    } else {
+      _spectrum.rate = value_in;
+    }
+    // a capture in progress was sized for the old settings
+    _spectrum.capturing = false;
+  } else if (key == "squelch") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    _rx_stream.squelch = value == "true";
+    _rx_stream.history_pending = 0;
+    _rx_stream.squelch_hold = 0;
+    _rx_stream.squelch_open = false;
+  } else if (key == "squelch_threshold" or key == "squelch_pre" or
+             key == "squelch_post") {
+    double value_in = 0.0;
+    try {
+      value_in = std::stod(value);
+    } catch (const std::exception &) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    if (key == "squelch_threshold") {
+      _rx_stream.squelch_threshold_db = value_in;
+      _rx_stream.squelch_threshold = (float)pow(10.0, value_in / 10.0);
+    } else if (key == "squelch_pre") {
+      // history lives in the ring, leave room for the trigger transfer
+      _rx_stream.squelch_pre = std::min<uint32_t>(
+          std::max(0.0, value_in), _rx_stream.buf_num - 1);
+      _rx_stream.history_pending =
+          std::min(_rx_stream.history_pending, _rx_stream.squelch_pre);
+    } else {
+      _rx_stream.squelch_post = std::max(0.0, value_in);
+    }
+  } else if (key == "tx_flush") {
+    this->flush_tx_queue(false);
+  } else if (key == "acquire_pre") {
+    double value_in = 0.0;
+    try {
+      value_in = std::stod(value);
+    } catch (const std::exception &) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    // history lives in the ring, leave room for the trigger transfer
+    const uint64_t max_pre =
+        _rx_stream.buf_num > 2 ? (uint64_t)(_rx_stream.buf_num - 2) *
+                                     (_rx_stream.buf_len / BYTES_PER_SAMPLE)
+                               : 0;
+    _rx_stream.acq_pre = std::min<uint64_t>(std::max(0.0, value_in), max_pre);
+  } else if (key == "preamble") {
+    if (value == "true") {
+      this->start_preamble();
+    } else {
+      this->stop_preamble();
+    }
+  } else if (key == "preamble_reference") {
+    std::vector<float> reference;
+    std::stringstream ss(value);
+    std::string item;
+    try {
+      while (std::getline(ss, item, ',')) reference.push_back(std::stof(item));
+    } catch (const std::exception &) {
+      reference.clear();
+    }
+    if (reference.empty() or reference.size() % 2 != 0) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "preamble_reference needs I,Q pairs");
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    _preamble.reference.swap(reference);
+    _preamble.reference_changed = true;
+  } else if (key == "preamble_threshold" or key == "preamble_pre" or
+             key == "preamble_post") {
+    double value_in = 0.0;
+    try {
+      value_in = std::stod(value);
+    } catch (const std::exception &) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "%s %s invalid", key.c_str(),
+                    value.c_str());
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    // a window has to fit in one ring slot
+    const size_t max_window = _rx_stream.buf_len / BYTES_PER_SAMPLE;
+    if (key == "preamble_threshold") {
+      _preamble.threshold = std::min(1.0, std::max(0.0, value_in));
+    } else if (key == "preamble_pre") {
+      _preamble.pre = std::min<size_t>(std::max(0.0, value_in),
+                                       max_window - _preamble.post);
+    } else {
+      _preamble.post = std::min<size_t>(std::max(1.0, value_in),
+                                        max_window - _preamble.pre);
+    }
+  } else if (key == "async_control") {
+    if (value == "true") {
+      this->start_control();
+    } else {
+      this->stop_control();
+    }
+  } else if (key == "callback_cpus") {
+    std::vector<int> cpus;
+    if (not HackRF_parseCpus(value, cpus)) {
+      SoapySDR_logf(SOAPY_SDR_ERROR, "callback_cpus %s invalid", value.c_str());
+      return;
+    }
+    HackRF_BoardManager::instance().set_callback_cpus(cpus);
+  } else if (key == "control_wait") {
+    // empty waits for everything issued so far
+    uint64_t seq = _control_issued;
+    if (not value.empty()) {
+      try {
+        seq = std::stoull(value);
+      } catch (const std::exception &) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "control_wait %s invalid",
+                      value.c_str());
+        return;
+      }
+    }
+    this->wait_control(seq);
+  } else if (key == "rx_callback") {
+    this->set_stream_callback(SOAPY_SDR_RX, value);
+  } else if (key == "tx_callback") {
+    this->set_stream_callback(SOAPY_SDR_TX, value);
   }
 }
 
 std::string SoapyHackRFDuplex::readSetting(const std::string &key) const {
   if (key == "bias_tx") {
     return _tx_stream.bias ? "true" : "false";
+  } else if (key == "async_control") {
+    std::lock_guard<std::mutex> lock(_rx_control.mutex);
+    return _rx_control.enabled ? "true" : "false";
+  } else if (key == "callback_cpus") {
+    const std::vector<int> cpus =
+        HackRF_BoardManager::instance().callback_cpus();
+    std::string out;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+      if (i > 0) out += ",";
+      out += std::to_string(cpus[i]);
+    }
+    return out;
+  } else if (key == "claimed_boards") {
+    // every board held in this process, not just this pair
+    std::string out;
+    for (const std::string &serial :
+         HackRF_BoardManager::instance().claimed_serials()) {
+      if (not out.empty()) out += ",";
+      out += serial;
+    }
+    return out;
+  } else if (key == "control_issued") {
+    return std::to_string(_control_issued);
+  } else if (key == "control_completed") {
+    return std::to_string(this->control_completed());
+  } else if (key == "control_errors") {
+    return std::to_string(_control_errors);
+  } else if (key == "rx_channels") {
+    return std::to_string(_rx_num_channels);
+  } else if (key == "rx_channelizer_rate") {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    return std::to_string(_rx_stream.samplerate);
+  } else if (key == "relay") {
+    return _relay.active ? "true" : "false";
+  } else if (key == "relay_gain") {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    return std::to_string(_relay.gain_db);
+  } else if (key == "relay_offset") {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    return std::to_string(_relay.offset);
+  } else if (key == "relay_latency_us") {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    return std::to_string(_relay.latency_us);
+  } else if (key == "relay_dropped") {
+    std::lock_guard<std::mutex> lock(_relay_mutex);
+    return std::to_string(_relay.dropped);
+  } else if (key == "record_path") {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    return _recorder.active ? _recorder.path + ".sigmf-data" : "";
+  } else if (key == "record_buffers") {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    return std::to_string(_recorder.buf_num);
+  } else if (key == "record_backlog") {
+    // bytes captured but not yet on disk
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    uint64_t backlog = 0;
+    for (uint32_t i = 0; i < _recorder.count; ++i) {
+      backlog += _recorder.lengths[(_recorder.head + i) % _recorder.buf_num];
+    }
+    return std::to_string(backlog);
+  } else if (key == "record_dropped") {
+    std::lock_guard<std::mutex> lock(_record_mutex);
+    return std::to_string(_recorder.dropped);
+  } else if (key == "playback_path") {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    return _playback.active ? _playback.path : "";
+  } else if (key == "playback_loop") {
+    return _playback.loop ? "true" : "false";
+  } else if (key == "playback_rate_check") {
+    return _playback.rate_check ? "true" : "false";
+  } else if (key == "playback_offset") {
+    return std::to_string(_playback.offset);
+  } else if (key == "playback_position") {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    return std::to_string(_playback.pos / BYTES_PER_SAMPLE);
+  } else if (key == "playback_finished") {
+    std::lock_guard<std::mutex> lock(_playback_mutex);
+    return _playback.finished ? "true" : "false";
+  } else if (key == "tx_start_time") {
+    // host time the TX board last started streaming, in ns
+    std::lock_guard<std::mutex> lock(_tx_device_mutex);
+    return std::to_string(_tx_stream.start_time_ns);
+  } else if (key == "tx_waveform") {
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    return std::to_string(_waveforms.current);
+  } else if (key == "tx_waveform_upload") {
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    return std::to_string(_waveforms.upload_id);
+  } else if (key == "tx_waveforms") {
+    // id:samples pairs of everything stored
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    std::string list;
+    for (std::map<int, std::vector<int8_t> >::const_iterator it =
+             _waveforms.waveforms.begin();
+         it != _waveforms.waveforms.end(); ++it) {
+      if (not list.empty()) list += ",";
+      list += std::to_string(it->first) + ":" +
+              std::to_string(it->second.size() / BYTES_PER_SAMPLE);
+    }
+    return list;
+  } else if (key == "spectrum") {
+    return _spectrum.active ? "true" : "false";
+  } else if (key == "spectrum_size") {
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    return std::to_string(_spectrum.size);
+  } else if (key == "spectrum_averages") {
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    return std::to_string(_spectrum.averages);
+  } else if (key == "spectrum_rate") {
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    return std::to_string(_spectrum.rate);
+  } else if (key == "squelch") {
+    return _rx_stream.squelch ? "true" : "false";
+  } else if (key == "squelch_threshold") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.squelch_threshold_db);
+  } else if (key == "squelch_pre") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.squelch_pre);
+  } else if (key == "squelch_post") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.squelch_post);
+  } else if (key == "acquire_pre") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.acq_pre);
+  } else if (key == "tx_dropped") {
+    // queued TX samples discarded by tx_flush or urgent writes
+    std::lock_guard<std::mutex> lock(_tx_buf_mutex);
+    return std::to_string(_tx_stream.dropped);
+  } else if (key == "rx_buffers") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.buf_num);
+  } else if (key == "rx_buffer_resizes") {
+    // oldest first, "15->22 overflow; 22->9 idle"
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    std::string out;
+    for (size_t i = 0; i < _rx_stream.resizes.size(); ++i) {
+      if (i > 0) out += "; ";
+      out += _rx_stream.resizes[i];
+    }
+    return out;
+  } else if (key == "rx_overflow_gaps") {
+    // samples lost to overflows as "index+count", oldest first
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    std::string out;
+    for (size_t i = 0; i < _rx_stream.gaps.size(); ++i) {
+      if (i > 0) out += "; ";
+      out += _rx_stream.gaps[i];
+    }
+    return out;
+  } else if (key == "rx_samples_lost") {
+    std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+    return std::to_string(_rx_stream.samples_lost);
+  } else if (key == "preamble") {
+    return _preamble.active ? "true" : "false";
+  } else if (key == "preamble_threshold") {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    return std::to_string(_preamble.threshold);
+  } else if (key == "preamble_pre") {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    return std::to_string(_preamble.pre);
+  } else if (key == "preamble_post") {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    return std::to_string(_preamble.post);
+  } else if (key == "preamble_detections") {
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    return std::to_string(_preamble.detections);
+  } else if (key == "preamble_dropped") {
+    // samples the worker could not keep up with
+    std::lock_guard<std::mutex> lock(_preamble_mutex);
+    return std::to_string(_preamble.dropped);
+  } else if (key == "rx_eventfd") {
+    // readable when RX buffers are ready, see HackRF_Notify.cpp
+    return std::to_string(_rx_notify.open());
+  } else if (key == "tx_eventfd") {
+    return std::to_string(_tx_notify.open());
+  } else if (key == "rx_callback" or key == "tx_callback") {
+    std::lock_guard<std::mutex> lock(_worker_mutex);
+    const bool registered = key == "rx_callback"
+                                ? _rx_worker.rx_fn != nullptr
+                                : _tx_worker.tx_fn != nullptr;
+    return registered ? "true" : "false";
   }
   return "";
 }
@@ -291,6 +1268,12 @@ bool SoapyHackRFDuplex::getGainMode(const int direction,
 
 void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
                                 const double value) {
+  if (this->defer_control(direction, "gain", [=] {
+        this->setGain(direction, channel, value);
+      })) {
+    return;
+  }
+
   int32_t ret(0), gain(0);
   gain = value;
   SoapySDR_logf(SOAPY_SDR_DEBUG, "setGain RF %s, channel %d, gain %d",
@@ -323,6 +1306,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
     }
 
     _rx_stream.amp_gain = _rx_current_amp;
+    this->publish_device_config(SOAPY_SDR_RX);
 
     ret = hackrf_set_lna_gain(_rx_dev, _rx_stream.lna_gain);
     ret |= hackrf_set_vga_gain(_rx_dev, _rx_stream.vga_gain);
@@ -342,6 +1326,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
     }
 
     _tx_stream.amp_gain = _tx_current_amp;
+    this->publish_device_config(SOAPY_SDR_TX);
 
     ret = hackrf_set_txvga_gain(_tx_dev, _tx_stream.vga_gain);
     ret |= hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
@@ -355,6 +1340,12 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
 
 void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
                                 const std::string &name, const double value) {
+  if (this->defer_control(direction, "gain " + name, [=] {
+        this->setGain(direction, channel, name, value);
+      })) {
+    return;
+  }
+
   SoapySDR_logf(SOAPY_SDR_DEBUG, "setGain %s %s, channel %d, gain %d",
                 name.c_str(), direction == SOAPY_SDR_RX ? "RX" : "TX", channel,
                 (int)value);
@@ -367,6 +1358,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
                                               : 0;  // clip to possible values
 
       _rx_stream.amp_gain = _rx_current_amp;
+      this->publish_device_config(SOAPY_SDR_RX);
       if (_rx_dev != NULL) {
         int ret = hackrf_set_amp_enable(_rx_dev, (_rx_current_amp > 0) ? 1 : 0);
         if (ret != HACKRF_SUCCESS) {
@@ -382,6 +1374,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
                                               : 0;  // clip to possible values
 
       _tx_stream.amp_gain = _tx_current_amp;
+      this->publish_device_config(SOAPY_SDR_TX);
 
       if (_tx_dev != NULL) {
         int ret = hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
@@ -396,6 +1389,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
 
     _rx_stream.lna_gain = value;
+    this->publish_device_config(SOAPY_SDR_RX);
     if (_rx_dev != NULL) {
       int ret = hackrf_set_lna_gain(_rx_dev, _rx_stream.lna_gain);
       if (ret != HACKRF_SUCCESS) {
@@ -407,6 +1401,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
   } else if (direction == SOAPY_SDR_RX and name == "VGA") {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
     _rx_stream.vga_gain = value;
+    this->publish_device_config(SOAPY_SDR_RX);
     if (_rx_dev != NULL) {
       int ret = hackrf_set_vga_gain(_rx_dev, _rx_stream.vga_gain);
       if (ret != HACKRF_SUCCESS) {
@@ -418,6 +1413,7 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
   } else if (direction == SOAPY_SDR_TX and name == "VGA") {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
     _tx_stream.vga_gain = value;
+    this->publish_device_config(SOAPY_SDR_TX);
     if (_tx_dev != NULL) {
       int ret = hackrf_set_txvga_gain(_tx_dev, _tx_stream.vga_gain);
       if (ret != HACKRF_SUCCESS) {
@@ -433,22 +1429,23 @@ void SoapyHackRFDuplex::setGain(const int direction, const size_t channel,
 
 double SoapyHackRFDuplex::getGain(const int direction, const size_t channel,
                                   const std::string &name) const {
+  // lock free, see publish_device_config()
+  ConfigSnapshot c;
+  if (direction == SOAPY_SDR_RX) {
+    c = _rx_config.load();
+  } else if (direction == SOAPY_SDR_TX) {
+    c = _tx_config.load();
+  } else {
+    return (0.0);
+  }
+
   double gain = 0.0;
-  if (direction == SOAPY_SDR_RX and name == "AMP") {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    gain = _rx_stream.amp_gain;
-  } else if (direction == SOAPY_SDR_TX and name == "AMP") {
-    std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    gain = _tx_stream.amp_gain;
+  if (name == "AMP") {
+    gain = c.amp_gain;
   } else if (direction == SOAPY_SDR_RX and name == "LNA") {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    gain = _rx_stream.lna_gain;
-  } else if (direction == SOAPY_SDR_RX and name == "VGA") {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    gain = _rx_stream.vga_gain;
-  } else if (direction == SOAPY_SDR_TX and name == "VGA") {
-    std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    gain = _tx_stream.vga_gain;
+    gain = c.lna_gain;
+  } else if (name == "VGA") {
+    gain = c.vga_gain;
   }
 
   return (gain);
@@ -474,23 +1471,101 @@ SoapySDR::Range SoapyHackRFDuplex::getGainRange(const int direction,
  * Frequency API
  ******************************************************************/
 
+void SoapyHackRFDuplex::setFrequency(const int direction, const size_t channel,
+                                     const double frequency,
+                                     const SoapySDR::Kwargs &args) {
+  // SoapySDR splits the frequency into RF and a BB residual read back
+  // from the RF setting, which a queued RF write has not changed yet. The
+  // whole split is queued as one write instead.
+  if (this->defer_control(direction, "frequency " + std::to_string(channel),
+                          [=] {
+                            this->setFrequency(direction, channel, frequency,
+                                               args);
+                          })) {
+    return;
+  }
+  SoapySDR::Device::setFrequency(direction, channel, frequency, args);
+}
+
 void SoapyHackRFDuplex::setFrequency(const int direction, const size_t channel,
                                      const std::string &name,
                                      const double frequency,
                                      const SoapySDR::Kwargs &args) {
+  if (name == "BB") {
+    // the NCO can only reach what the board captures, checked before
+    // queueing so a bad offset still throws to the caller
+    const ConfigSnapshot c =
+        direction == SOAPY_SDR_RX ? _rx_config.load() : _tx_config.load();
+    if (fabs(frequency) > c.samplerate / 2.0)
+      throw std::runtime_error("setFrequency(BB) offset " +
+                               std::to_string(frequency) +
+                               " outside the captured span");
+  }
+
+  // BB writes are queued too, an RF write with nco_span also moves the NCO
+  const std::string control_key =
+      "frequency " + name + " " + std::to_string(channel);
+  if (this->defer_control(direction, control_key, [=] {
+        this->setFrequency(direction, channel, name, frequency, args);
+      })) {
+    return;
+  }
 
   SoapySDR_logf(SOAPY_SDR_DEBUG, "Setting Frequency %s Channel %d, Freq. %f Hz...",
     direction == SOAPY_SDR_RX ? "RX" : direction == SOAPY_SDR_TX ? "TX" : "<Unknown>",
     channel, frequency);
 
-  if (name == "BB") return;
+  if (name == "BB") {
+    // digital tuning within the captured span, no USB transfer involved
+    if (direction == SOAPY_SDR_RX) {
+      if (channel >= _rx_num_channels)
+        throw std::runtime_error("setFrequency() invalid channel");
+      std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+      _rx_stream.channels[channel].offset = frequency;
+      this->plan_rx_channels();
+    } else if (direction == SOAPY_SDR_TX) {
+      std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+      _tx_stream.offset = frequency;
+      this->plan_tx_dsp();
+    }
+    return;
+  }
   if (name != "RF")
     throw std::runtime_error("setFrequency(" + name + ") unknown name");
 
+  // offset policy: hops within nco_span of the current LO only move the NCO
+  double nco_span = 0.0;
+  if (args.count("nco_span") != 0) {
+    try {
+      nco_span = std::stod(args.at("nco_span"));
+    } catch (const std::invalid_argument &) {
+    }
+  }
+
   if (direction == SOAPY_SDR_RX) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
+
+    if (channel >= _rx_num_channels)
+      throw std::runtime_error("setFrequency() invalid channel");
+
+    if (nco_span > 0.0) {
+      const double offset = frequency - double(_rx_stream.frequency);
+      const double limit =
+          std::min(nco_span, _rx_stream.samplerate / 2.0);
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      if (_rx_stream.frequency != 0 and fabs(offset) <= limit) {
+        _rx_stream.channels[channel].offset = offset;
+        this->plan_rx_channels();
+        return;
+      }
+      // out of span, the LO moves to the target and the NCO is centred
+      _rx_stream.channels[channel].offset = 0.0;
+      this->plan_rx_channels();
+    }
+
     _rx_current_frequency = frequency;
     _rx_stream.frequency = _rx_current_frequency;
+    this->publish_device_config(SOAPY_SDR_RX);
     if (_rx_dev != NULL) {
       int ret = hackrf_set_freq(_rx_dev, _rx_current_frequency);
 
@@ -502,8 +1577,24 @@ void SoapyHackRFDuplex::setFrequency(const int direction, const size_t channel,
     }
   } else if (direction == SOAPY_SDR_TX) {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
+
+    if (nco_span > 0.0) {
+      const double offset = frequency - double(_tx_stream.frequency);
+      const double limit =
+          std::min(nco_span, _tx_stream.samplerate / 2.0);
+      std::lock_guard<std::mutex> dsp_lock(_tx_dsp_mutex);
+      if (_tx_stream.frequency != 0 and fabs(offset) <= limit) {
+        _tx_stream.offset = offset;
+        this->plan_tx_dsp();
+        return;
+      }
+      _tx_stream.offset = 0.0;
+      this->plan_tx_dsp();
+    }
+
     _tx_current_frequency = frequency;
     _tx_stream.frequency = _tx_current_frequency;
+    this->publish_device_config(SOAPY_SDR_TX);
     if (_tx_dev != NULL) {
       int ret = hackrf_set_freq(_tx_dev, _tx_current_frequency);
 
@@ -519,26 +1610,35 @@ void SoapyHackRFDuplex::setFrequency(const int direction, const size_t channel,
 double SoapyHackRFDuplex::getFrequency(const int direction,
                                        const size_t channel,
                                        const std::string &name) const {
-  if (name == "BB") return (0.0);
-  if (name != "RF")
+  if (name != "BB" and name != "RF")
     throw std::runtime_error("getFrequency(" + name + ") unknown name");
 
-  double freq(0.0);
-
   if (direction == SOAPY_SDR_RX) {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    freq = _rx_stream.frequency;
+    const ConfigSnapshot c = _rx_config.load();
+    if (name == "RF") return (c.frequency);
+    return (channel < _rx_num_channels ? c.offset[channel] : 0.0);
   } else if (direction == SOAPY_SDR_TX) {
-    std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    freq = _tx_stream.frequency;
+    const ConfigSnapshot c = _tx_config.load();
+    return (name == "RF" ? c.frequency : c.offset[0]);
   }
-  return (freq);
+  return (0.0);
 }
 
 SoapySDR::ArgInfoList SoapyHackRFDuplex::getFrequencyArgsInfo(
     const int direction, const size_t channel) const {
   SoapySDR::ArgInfoList freqArgs;
-  // TODO: frequency arguments
+
+  SoapySDR::ArgInfo ncoSpanArg;
+  ncoSpanArg.key = "nco_span";
+  ncoSpanArg.value = "0";
+  ncoSpanArg.name = "NCO Span";
+  ncoSpanArg.description =
+      "RF tuning within this distance of the current LO is done by the "
+      "digital NCO alone, without retuning the board. 0 always retunes.";
+  ncoSpanArg.units = "Hz";
+  ncoSpanArg.type = SoapySDR::ArgInfo::FLOAT;
+  freqArgs.push_back(ncoSpanArg);
+
   return freqArgs;
 }
 
@@ -546,12 +1646,23 @@ std::vector<std::string> SoapyHackRFDuplex::listFrequencies(
     const int direction, const size_t channel) const {
   std::vector<std::string> names;
   names.push_back("RF");
+  names.push_back("BB");
   return (names);
 }
 
 SoapySDR::RangeList SoapyHackRFDuplex::getFrequencyRange(
     const int direction, const size_t channel, const std::string &name) const {
-  if (name == "BB") return (SoapySDR::RangeList(1, SoapySDR::Range(0.0, 0.0)));
+  if (name == "BB") {
+    double half = 0.0;
+    if (direction == SOAPY_SDR_RX) {
+      std::lock_guard<std::mutex> lock(_rx_device_mutex);
+      half = _rx_stream.samplerate / 2.0;
+    } else if (direction == SOAPY_SDR_TX) {
+      std::lock_guard<std::mutex> lock(_tx_device_mutex);
+      half = _tx_stream.samplerate / 2.0;
+    }
+    return (SoapySDR::RangeList(1, SoapySDR::Range(-half, half)));
+  }
   if (name != "RF")
     throw std::runtime_error("getFrequencyRange(" + name + ") unknown name");
   return (SoapySDR::RangeList(1, SoapySDR::Range(0, 7250000000ull)));
@@ -565,23 +1676,54 @@ void SoapyHackRFDuplex::setSampleRate(const int direction, const size_t channel,
                                       const double rate) {
   if (direction == SOAPY_SDR_RX) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    _rx_current_samplerate = rate;
-    _rx_stream.samplerate = _rx_current_samplerate;
 
-    if (_rx_dev != NULL) {
-      int ret = hackrf_set_sample_rate(_rx_dev, _rx_current_samplerate);
+    if (_rx_num_channels > 1) {
+      // channelizer: the board rate is fixed, the channel's DDC reaches the
+      // requested rate by decimation and resampling
+      if (channel >= _rx_num_channels)
+        throw std::runtime_error("setSampleRate() invalid channel");
+      if (rate <= 0.0 or rate > _rx_stream.samplerate)
+        throw std::runtime_error("setSampleRate() rate out of range");
+
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      _rx_stream.channels[channel].user_rate = rate;
+      this->plan_rx_channels();
+      return;
+    }
 
-      if (ret != HACKRF_SUCCESS) {
-        SoapySDR::logf(
-            SOAPY_SDR_ERROR, "hackrf_set_sample_rate(%f) returned %s",
-            _rx_current_samplerate, hackrf_error_name((hackrf_error)ret));
-        throw std::runtime_error("setSampleRate()");
-      }
+    // run the board at an exactly reachable rate and make up the difference
+    // in the DDC
+    size_t decim = 1;
+    const double board = HackRF_plan_board_rate(
+        rate, HACKRF_MIN_SAMPLE_RATE, HACKRF_MAX_SAMPLE_RATE, decim);
+    {
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      _rx_stream.channels[0].user_rate = rate;
     }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "setSampleRate RX %f, board %f", rate,
+                  board);
+    this->set_rx_board_rate(board);
   } else if (direction == SOAPY_SDR_TX) {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    _tx_current_samplerate = rate;
+
+    // rates the board can not run exactly are reached by interpolation and
+    // fractional resampling in the DUC
+    size_t interp = 1;
+    const double board = HackRF_plan_board_rate(
+        rate, HACKRF_MIN_SAMPLE_RATE, HACKRF_MAX_SAMPLE_RATE, interp);
+    {
+      std::lock_guard<std::mutex> dsp_lock(_tx_dsp_mutex);
+      _tx_stream.user_rate = rate;
+      _tx_stream.interp = interp;
+      _tx_stream.ratio = (rate > 0.0) ? board / interp / rate : 1.0;
+      this->plan_tx_dsp();
+    }
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "setSampleRate TX %f, board %f", rate,
+                  board);
+
+    _tx_current_samplerate = board;
     _tx_stream.samplerate = _tx_current_samplerate;
+    this->publish_device_config(SOAPY_SDR_TX);
 
     if (_tx_dev != NULL) {
       int ret = hackrf_set_sample_rate(_tx_dev, _tx_current_samplerate);
@@ -596,16 +1738,116 @@ void SoapyHackRFDuplex::setSampleRate(const int direction, const size_t channel,
   }
 }
 
+void SoapyHackRFDuplex::set_rx_board_rate(const double rate) {
+  _rx_current_samplerate = rate;
+  _rx_stream.samplerate = _rx_current_samplerate;
+  this->publish_device_config(SOAPY_SDR_RX);
+
+  {
+    std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+    this->plan_rx_channels();
+  }
+
+  if (_rx_dev != NULL) {
+    int ret = hackrf_set_sample_rate(_rx_dev, _rx_current_samplerate);
+
+    if (ret != HACKRF_SUCCESS) {
+      SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_set_sample_rate(%f) returned %s",
+                     _rx_current_samplerate,
+                     hackrf_error_name((hackrf_error)ret));
+      throw std::runtime_error("setSampleRate()");
+    }
+  }
+}
+
+void SoapyHackRFDuplex::plan_rx_channels(void) {
+  const double board = _rx_stream.samplerate;
+
+  for (size_t i = 0; i < _rx_stream.channels.size(); ++i) {
+    RXChannel &ch = _rx_stream.channels[i];
+    if (ch.user_rate <= 0.0 or board <= 0.0 or ch.user_rate >= board) {
+      ch.decim = 1;
+      ch.ratio = 1.0;
+      continue;
+    }
+    // integer decimation first, the resampler covers the remainder; the
+    // tolerance keeps rates like 10e6 / 3 from flooring one short
+    ch.decim =
+        std::max<size_t>(1, (size_t)floor(board / ch.user_rate + 1e-9));
+    ch.ratio = ch.user_rate / (board / ch.decim);
+    if (fabs(ch.ratio - 1.0) < 1e-12) ch.ratio = 1.0;
+  }
+
+  // a single channel at the board rate with no offset reads the transfer
+  // buffers directly; the reader switches paths in sync_rx_path()
+  const RXChannel &first = _rx_stream.channels[0];
+  _rx_stream.dsp_wanted = (_rx_num_channels > 1 or first.decim > 1 or
+                           first.ratio != 1.0 or first.offset != 0.0);
+  _rx_stream.dsp_dirty = true;
+  this->publish_dsp_config(SOAPY_SDR_RX);
+}
+
+void SoapyHackRFDuplex::plan_tx_dsp(void) {
+  _tx_stream.dsp_wanted = (_tx_stream.interp > 1 or
+                           _tx_stream.ratio != 1.0 or _tx_stream.offset != 0.0);
+  _tx_stream.dsp_dirty = true;
+  this->publish_dsp_config(SOAPY_SDR_TX);
+}
+
+void SoapyHackRFDuplex::publish_device_config(const int direction) {
+  if (direction == SOAPY_SDR_RX) {
+    const RXStream &s = _rx_stream;
+    _rx_config.update([&s](ConfigSnapshot &c) {
+      c.frequency = s.frequency;
+      c.samplerate = s.samplerate;
+      c.bandwidth = s.bandwidth;
+      c.lna_gain = s.lna_gain;
+      c.vga_gain = s.vga_gain;
+      c.amp_gain = s.amp_gain;
+    });
+  } else if (direction == SOAPY_SDR_TX) {
+    const TXStream &s = _tx_stream;
+    _tx_config.update([&s](ConfigSnapshot &c) {
+      c.frequency = s.frequency;
+      c.samplerate = s.samplerate;
+      c.bandwidth = s.bandwidth;
+      c.lna_gain = 0.0;
+      c.vga_gain = s.vga_gain;
+      c.amp_gain = s.amp_gain;
+    });
+  }
+}
+
+void SoapyHackRFDuplex::publish_dsp_config(const int direction) {
+  if (direction == SOAPY_SDR_RX) {
+    const std::vector<RXChannel> &channels = _rx_stream.channels;
+    _rx_config.update([&channels](ConfigSnapshot &c) {
+      for (size_t i = 0; i < HACKRF_MAX_RX_CHANNELS; ++i) {
+        c.offset[i] = i < channels.size() ? channels[i].offset : 0.0;
+        c.user_rate[i] = i < channels.size() ? channels[i].user_rate : 0.0;
+      }
+    });
+  } else if (direction == SOAPY_SDR_TX) {
+    const TXStream &s = _tx_stream;
+    _tx_config.update([&s](ConfigSnapshot &c) {
+      c.offset[0] = s.offset;
+      c.user_rate[0] = s.user_rate;
+    });
+  }
+}
+
 double SoapyHackRFDuplex::getSampleRate(const int direction,
                                         const size_t channel) const {
   double samp(0.0);
   if (direction == SOAPY_SDR_RX) {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    samp = _rx_stream.samplerate;
+    const ConfigSnapshot c = _rx_config.load();
+    samp = c.samplerate;
+    if (channel < _rx_num_channels and c.user_rate[channel] > 0.0)
+      samp = c.user_rate[channel];
   }
   if (direction == SOAPY_SDR_TX) {
-    std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    samp = _tx_stream.samplerate;
+    const ConfigSnapshot c = _tx_config.load();
+    samp = (c.user_rate[0] > 0.0) ? c.user_rate[0] : c.samplerate;
   }
 
   return (samp);
@@ -622,11 +1864,18 @@ std::vector<double> SoapyHackRFDuplex::listSampleRates(
 
 void SoapyHackRFDuplex::setBandwidth(const int direction, const size_t channel,
                                      const double bw) {
+  if (this->defer_control(direction, "bandwidth", [=] {
+        this->setBandwidth(direction, channel, bw);
+      })) {
+    return;
+  }
+
   if (direction == SOAPY_SDR_RX) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
     _rx_current_bandwidth = bw;
 
     _rx_stream.bandwidth = _rx_current_bandwidth;
+    this->publish_device_config(SOAPY_SDR_RX);
 
     if (_rx_current_bandwidth > 0) {
       _rx_auto_bandwidth = false;
@@ -650,6 +1899,7 @@ void SoapyHackRFDuplex::setBandwidth(const int direction, const size_t channel,
     _tx_current_bandwidth = bw;
 
     _tx_stream.bandwidth = _tx_current_bandwidth;
+    this->publish_device_config(SOAPY_SDR_TX);
 
     if (_tx_current_bandwidth > 0) {
       _tx_auto_bandwidth = false;
@@ -675,14 +1925,8 @@ double SoapyHackRFDuplex::getBandwidth(const int direction,
                                        const size_t channel) const {
   double bw(0.0);
 
-  if (direction == SOAPY_SDR_RX) {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
-    bw = _rx_stream.bandwidth;
-  }
-  if (direction == SOAPY_SDR_TX) {
-    std::lock_guard<std::mutex> lock(_tx_device_mutex);
-    bw = _tx_stream.bandwidth;
-  }
+  if (direction == SOAPY_SDR_RX) bw = _rx_config.load().bandwidth;
+  if (direction == SOAPY_SDR_TX) bw = _tx_config.load().bandwidth;
 
   return (bw);
 }
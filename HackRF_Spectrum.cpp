@@ -0,0 +1,206 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+#include <cstdio>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * The spectrum monitor copies size * averages samples out of the RX callback
+ * spectrum_rate times a second and leaves every other transfer alone. A
+ * worker thread turns each capture into averaged power bins, so the
+ * callback only pays for a memcpy and the monitor costs next to nothing
+ * between updates. It runs beside an application RX stream, or opens the RX
+ * stream itself when there is none.
+ */
+
+int SoapyHackRFDuplex::start_spectrum(void) {
+  if (_spectrum.worker.joinable()) return 0;
+
+  bool rx_opened;
+  {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    rx_opened = _rx_stream.opened;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    _spectrum.capturing = false;
+    _spectrum.ready = false;
+    _spectrum.next_ns = 0;
+    _spectrum.stop = false;
+    _spectrum.bins.clear();
+    _spectrum.bins_ns = 0;
+    _spectrum.updates = 0;
+  }
+  _spectrum.worker = std::thread(&SoapyHackRFDuplex::spectrum_worker, this);
+  _spectrum.active = true;
+
+  if (not rx_opened) {
+    this->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS8);
+    _spectrum.owns_rx = true;
+    int ret = this->activateStream(RX_STREAM);
+    if (ret != 0) {
+      this->stop_spectrum();
+      return ret;
+    }
+  }
+  return 0;
+}
+
+void SoapyHackRFDuplex::stop_spectrum(void) {
+  if (not _spectrum.worker.joinable()) return;
+
+  if (_spectrum.owns_rx) {
+    this->closeStream(RX_STREAM);
+    _spectrum.owns_rx = false;
+  }
+  _spectrum.active = false;
+
+  {
+    std::lock_guard<std::mutex> lock(_spectrum_mutex);
+    _spectrum.stop = true;
+  }
+  _spectrum.cond.notify_one();
+  _spectrum.worker.join();
+}
+
+void SoapyHackRFDuplex::spectrum_push(const int8_t *buffer, int32_t length) {
+  std::lock_guard<std::mutex> lock(_spectrum_mutex);
+  if (not _spectrum.active) return;
+
+  if (not _spectrum.capturing) {
+    // the worker still has the last capture, or the next is not due yet
+    if (_spectrum.ready) return;
+    const long long now = HackRF_timeNs();
+    if (now < _spectrum.next_ns) return;
+
+    _spectrum.capture.resize(_spectrum.size * _spectrum.averages *
+                             BYTES_PER_SAMPLE);
+    _spectrum.captured = 0;
+    _spectrum.capture_ns = now;
+    _spectrum.next_ns =
+        now + (_spectrum.rate > 0 ? (long long)(1e9 / _spectrum.rate) : 0);
+    _spectrum.capturing = true;
+  }
+
+  // consecutive transfers, so the capture stays contiguous in time
+  const size_t n = std::min<size_t>(
+      length, _spectrum.capture.size() - _spectrum.captured);
+  memcpy(_spectrum.capture.data() + _spectrum.captured, buffer, n);
+  _spectrum.captured += n;
+
+  if (_spectrum.captured == _spectrum.capture.size()) {
+    _spectrum.capturing = false;
+    _spectrum.ready = true;
+    _spectrum.cond.notify_one();
+  }
+}
+
+void SoapyHackRFDuplex::spectrum_worker(void) {
+  std::unique_lock<std::mutex> lock(_spectrum_mutex);
+
+  while (true) {
+    _spectrum.cond.wait(lock,
+                        [this] { return _spectrum.ready or _spectrum.stop; });
+    if (_spectrum.stop) break;
+
+    // take the capture so the callback can start the next one into the
+    // swapped buffer while this one is transformed
+    _spectrum.frames.swap(_spectrum.capture);
+    const size_t size = _spectrum.size;
+    const long long capture_ns = _spectrum.capture_ns;
+    _spectrum.ready = false;
+    lock.unlock();
+
+    if (_spectrum.spectrum.size() != size) _spectrum.spectrum.configure(size);
+    _spectrum.spectrum.reset();
+    _spectrum.work.resize(size * BYTES_PER_SAMPLE);
+    const size_t frame_bytes = size * BYTES_PER_SAMPLE;
+    for (size_t off = 0; off + frame_bytes <= _spectrum.frames.size();
+         off += frame_bytes) {
+      HackRF_cs8_to_cf32(_spectrum.frames.data() + off, _spectrum.work.data(),
+                         size);
+      _spectrum.spectrum.accumulate(_spectrum.work.data());
+    }
+    std::vector<float> bins;
+    _spectrum.spectrum.result(bins);
+
+    lock.lock();
+    // resized while this capture was taken, wait for the next one
+    if (_spectrum.spectrum.frames() == 0) continue;
+    _spectrum.bins.swap(bins);
+    _spectrum.bins_ns = capture_ns;
+    _spectrum.updates++;
+  }
+}
+
+/*******************************************************************
+ * Sensor API
+ ******************************************************************/
+
+std::vector<std::string> SoapyHackRFDuplex::listSensors(void) const {
+  std::vector<std::string> sensors;
+  sensors.push_back("spectrum");
+  sensors.push_back("spectrum_time");
+  return sensors;
+}
+
+SoapySDR::ArgInfo SoapyHackRFDuplex::getSensorInfo(
+    const std::string &key) const {
+  SoapySDR::ArgInfo info;
+  info.key = key;
+  if (key == "spectrum") {
+    info.name = "RX Spectrum";
+    info.description =
+        "Comma separated averaged power bins from the spectrum monitor, "
+        "lowest frequency first, spanning the RX board sample rate around "
+        "the RX frequency. Empty until the first update.";
+    info.units = "dBFS";
+    info.type = SoapySDR::ArgInfo::STRING;
+  } else if (key == "spectrum_time") {
+    info.name = "RX Spectrum Time";
+    info.description = "Host time the current spectrum bins were captured.";
+    info.units = "ns";
+    info.type = SoapySDR::ArgInfo::INT;
+  }
+  return info;
+}
+
+std::string SoapyHackRFDuplex::readSensor(const std::string &key) const {
+  std::lock_guard<std::mutex> lock(_spectrum_mutex);
+  if (key == "spectrum") {
+    std::string bins;
+    bins.reserve(_spectrum.bins.size() * 7);
+    char bin[16];
+    for (size_t i = 0; i < _spectrum.bins.size(); ++i) {
+      snprintf(bin, sizeof(bin), i == 0 ? "%.1f" : ",%.1f", _spectrum.bins[i]);
+      bins += bin;
+    }
+    return bins;
+  } else if (key == "spectrum_time") {
+    return std::to_string(_spectrum.bins_ns);
+  }
+  return "";
+}
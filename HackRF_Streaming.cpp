@@ -25,10 +25,18 @@
 #include <SoapySDR/Logger.hpp>
 #include <algorithm>  //min
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <thread>
 
 #include "SoapyHackRFDuplex.hpp"
 
+long long HackRF_timeNs(void) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
 int _hackrf_rx_callback(hackrf_transfer *transfer) {
   SoapyHackRFDuplex *obj = (SoapyHackRFDuplex *)transfer->rx_ctx;
   return (obj->hackrf_rx_callback((int8_t *)transfer->buffer,
@@ -42,43 +50,289 @@ int _hackrf_tx_callback(hackrf_transfer *transfer) {
 }
 
 int SoapyHackRFDuplex::hackrf_rx_callback(int8_t *buffer, int32_t length) {
+  HackRF_BoardManager::instance().place_callback_thread();
+  if (_relay.active) this->relay_forward(buffer, length);
+  if (_recorder.active) this->record_push(buffer, length);
+  if (_spectrum.active) this->spectrum_push(buffer, length);
+
+  const uint32_t len = std::min<uint32_t>(length, _rx_stream.buf_len);
+  const uint64_t n = len / BYTES_PER_SAMPLE;
+
+  // the squelch level is measured before taking the lock
+  const bool squelch = _rx_stream.squelch;
+  const float power = squelch ? HackRF_cs8_power(buffer, n) : 0.0f;
+
   std::unique_lock<std::mutex> lock(_rx_buf_mutex);
-  _rx_stream.buf_tail =
-      (_rx_stream.buf_head + _rx_stream.buf_count) % _rx_stream.buf_num;
-  memcpy(_rx_stream.buf[_rx_stream.buf_tail], buffer, length);
+  const uint32_t num = _rx_stream.buf_num;
+
+  // timed by sample count since the start, so squelch gaps are exact
+  const uint64_t index = _rx_stream.sample_index;
+  _rx_stream.sample_index += n;
+  const long long time_ns =
+      _rx_stream.start_time_ns +
+      (_rx_stream.samplerate > 0
+           ? (long long)(index * 1e9 / _rx_stream.samplerate)
+           : 0);
+
+  // the preamble detector decides what reaches the ring
+  if (_preamble.active) {
+    lock.unlock();
+    if (not _rx_stream.paused) this->preamble_push(buffer, len, index);
+    return (0);
+  }
 
-  if (_rx_stream.buf_count == _rx_stream.buf_num) {
-    _rx_stream.overflow = true;
-    _rx_stream.buf_head = (_rx_stream.buf_head + 1) % _rx_stream.buf_num;
+  bool commit = true;
+  bool burst_end = false;
+  uint32_t history = squelch ? _rx_stream.squelch_pre : 0;
+  if (_rx_stream.acq) {
+    // transfers covering acq_pre samples, the trigger may fall mid transfer
+    history = _rx_stream.acq_pre > 0
+                  ? std::min<uint64_t>((_rx_stream.acq_pre + n - 1) / n + 1,
+                                       num - 1)
+                  : 0;
+  }
+  // the part of the transfer that is committed
+  uint64_t skip = 0;
+  uint64_t take = n;
+  if (_rx_stream.paused) {
+    // hot standby, the index runs on and history fills but nothing commits
+    commit = false;
+  } else if (_rx_stream.acq) {
+    commit = index + n > _rx_stream.acq_start and index < _rx_stream.acq_end;
+    if (commit) {
+      skip = index < _rx_stream.acq_start ? _rx_stream.acq_start - index : 0;
+      take = std::min<uint64_t>(n, _rx_stream.acq_end - index) - skip;
+      burst_end = index + n >= _rx_stream.acq_end;
+    }
+  } else if (squelch) {
+    if (power >= _rx_stream.squelch_threshold) {
+      _rx_stream.squelch_hold = _rx_stream.squelch_post;
+      _rx_stream.squelch_open = true;
+    } else if (_rx_stream.squelch_hold > 0) {
+      burst_end = --_rx_stream.squelch_hold == 0;
+      if (burst_end) _rx_stream.squelch_open = false;
+    } else {
+      commit = false;
+    }
+  }
+
+  const uint32_t ready = _rx_stream.buf_count - _rx_stream.buf_held;
+  const long long start_ns =
+      skip > 0 and _rx_stream.samplerate > 0
+          ? time_ns + (long long)(skip * 1e9 / _rx_stream.samplerate)
+          : time_ns;
+  bool overflowed = false;
+  uint32_t slot;
+
+  if (not commit) {
+    if (_rx_stream.squelch_open) {
+      // no post-trigger transfers, end the burst on the last one if the
+      // reader has not taken it yet
+      if (ready > 0) {
+        _rx_stream.buf_burst_end[(_rx_stream.buf_head + ready - 1) % num] = 1;
+      }
+      _rx_stream.squelch_open = false;
+    }
+
+    // keep the transfer as history after the committed slots, dropping
+    // the oldest history by rotating the slot pointers
+    uint32_t &pending = _rx_stream.history_pending;
+    const uint32_t first = (_rx_stream.buf_head + ready) % num;
+    if (pending < history and _rx_stream.spill.empty() and
+        _rx_stream.buf_count + pending < num) {
+      pending++;
+    } else if (pending > 0) {
+      for (uint32_t i = 0; i + 1 < pending; ++i) {
+        const uint32_t a = (first + i) % num;
+        const uint32_t b = (first + i + 1) % num;
+        std::swap(_rx_stream.buf[a], _rx_stream.buf[b]);
+        std::swap(_rx_stream.buf_samps[a], _rx_stream.buf_samps[b]);
+        std::swap(_rx_stream.buf_index[a], _rx_stream.buf_index[b]);
+        std::swap(_rx_stream.buf_time[a], _rx_stream.buf_time[b]);
+      }
+    } else {
+      return (0);
+    }
+    slot = (first + pending - 1) % num;
   } else {
-    _rx_stream.buf_count++;
+    uint32_t &pending = _rx_stream.history_pending;
+    if (_rx_stream.acq and pending > 0) {
+      pending = this->trim_rx_history((_rx_stream.buf_head + ready) % num,
+                                      pending, _rx_stream.acq_start);
+    }
+    const HackRF_Overflow policy = _rx_stream.overflow_policy;
+    if (policy == HACKRF_OVERFLOW_SPILL and
+        (not _rx_stream.spill.empty() or
+         _rx_stream.buf_count + pending >= num)) {
+      // queue behind what is already spilled, history first, then give
+      // back to the ring whatever fits
+      this->spill_rx_history();
+      this->spill_rx(buffer + skip * BYTES_PER_SAMPLE, take, index + skip,
+                     start_ns, burst_end);
+      this->unspill_rx();
+      this->track_rx_depth(true);
+      _rx_buf_cond.notify_one();
+      lock.unlock();
+      _rx_notify.signal();
+      return (0);
+    }
+    if (_rx_stream.buf_count + pending >= num) {
+      // no room for all of the history, the newest of it is lost
+      const uint32_t keep =
+          _rx_stream.buf_count < num ? num - 1 - _rx_stream.buf_count : 0;
+      for (uint32_t i = keep; i < pending; ++i) {
+        const uint32_t h = (_rx_stream.buf_head + ready + i) % num;
+        this->note_rx_loss(_rx_stream.buf_index[h], _rx_stream.buf_samps[h],
+                           _rx_stream.buf_time[h]);
+      }
+      pending = keep;
+    }
+
+    if (_rx_stream.buf_count < num) {
+      slot = (_rx_stream.buf_head + ready + pending) % num;
+      _rx_stream.buf_count += pending + 1;
+      pending = 0;
+    } else if (policy == HACKRF_OVERFLOW_DROP_OLDEST and
+               _rx_stream.buf_held == 0) {
+      // full, overwrite the oldest committed transfer
+      overflowed = true;
+      slot = _rx_stream.buf_head;
+      this->note_rx_loss(_rx_stream.buf_index[slot],
+                         _rx_stream.buf_samps[slot], _rx_stream.buf_time[slot]);
+      _rx_stream.buf_head = (_rx_stream.buf_head + 1) % num;
+    } else {
+      // drop this transfer, by policy or because the oldest slots are
+      // with the reader
+      this->note_rx_loss(index + skip, take, start_ns);
+      this->track_rx_depth(true);
+      return (0);
+    }
   }
+
+  memcpy(_rx_stream.buf[slot], buffer + skip * BYTES_PER_SAMPLE,
+         take * BYTES_PER_SAMPLE);
+  _rx_stream.buf_samps[slot] = take;
+  _rx_stream.buf_index[slot] = index + skip;
+  _rx_stream.buf_time[slot] = start_ns;
+  _rx_stream.buf_burst_end[slot] = burst_end;
+  if (not commit) return (0);
+  if (not overflowed) this->close_rx_gap();
+  this->track_rx_depth(overflowed);
+
   _rx_buf_cond.notify_one();
+  lock.unlock();
+  _rx_notify.signal();
 
   return (0);
 }
 
+uint32_t SoapyHackRFDuplex::trim_rx_history(uint32_t first, uint32_t pending,
+                                            uint64_t start) {
+  // history before the window is not part of the acquisition, move the
+  // slots that reach into it to the front
+  const uint32_t num = _rx_stream.buf_num;
+  uint32_t drop = 0;
+  while (drop < pending) {
+    const uint32_t slot = (first + drop) % num;
+    if (_rx_stream.buf_index[slot] + _rx_stream.buf_samps[slot] > start) break;
+    drop++;
+  }
+  for (uint32_t i = 0; drop > 0 and i + drop < pending; ++i) {
+    const uint32_t a = (first + i) % num;
+    const uint32_t b = (first + i + drop) % num;
+    std::swap(_rx_stream.buf[a], _rx_stream.buf[b]);
+    std::swap(_rx_stream.buf_samps[a], _rx_stream.buf_samps[b]);
+    std::swap(_rx_stream.buf_index[a], _rx_stream.buf_index[b]);
+    std::swap(_rx_stream.buf_time[a], _rx_stream.buf_time[b]);
+  }
+  pending -= drop;
+  if (pending == 0 or _rx_stream.buf_index[first] >= start) return pending;
+
+  // and cut the first one at the start of the window
+  const uint64_t skip = start - _rx_stream.buf_index[first];
+  _rx_stream.buf_samps[first] -= skip;
+  memmove(_rx_stream.buf[first],
+          _rx_stream.buf[first] + skip * BYTES_PER_SAMPLE,
+          _rx_stream.buf_samps[first] * BYTES_PER_SAMPLE);
+  _rx_stream.buf_index[first] = start;
+  if (_rx_stream.samplerate > 0) {
+    _rx_stream.buf_time[first] +=
+        (long long)(skip * 1e9 / _rx_stream.samplerate);
+  }
+  return pending;
+}
+
 int SoapyHackRFDuplex::hackrf_tx_callback(int8_t *buffer, int32_t length) {
-  std::unique_lock<std::mutex> lock(_tx_buf_mutex);
-  if (_tx_stream.buf_count == 0) {
+  HackRF_BoardManager::instance().place_callback_thread();
+  if (_playback.active) {
+    this->playback_fill(buffer, length);
+    return (0);
+  }
+  if (_tx_stream.paused) {
+    // hot standby, the queue waits for the stream to be activated again
     memset(buffer, 0, length);
-    _tx_stream.underflow = true;
-  } else {
-    memcpy(buffer, _tx_stream.buf[_tx_stream.buf_tail], length);
-    _tx_stream.buf_tail = (_tx_stream.buf_tail + 1) % _tx_stream.buf_num;
-
-    _tx_stream.buf_count--;
+    return (0);
+  }
+  if (_tx_stream.cyclic) {
+    this->cyclic_fill(buffer, length);
+    return (0);
+  }
 
-    if (_tx_stream.burst_end) {
-      _tx_stream.burst_samps -= (length / BYTES_PER_SAMPLE);
-      if (_tx_stream.burst_samps < 0) {
-        _tx_stream.burst_end = false;
-        _tx_stream.burst_samps = 0;
-        return -1;
+  std::unique_lock<std::mutex> lock(_tx_buf_mutex);
+  const bool freed = _tx_stream.buf_count != 0;
+
+  // slots may be short, fill the transfer from as many as it takes; bursts
+  // follow each other in the same transfer, so short bursts cost no more
+  // than their samples
+  const size_t want = length / BYTES_PER_SAMPLE;
+  size_t filled = 0;
+  while (filled < want and _tx_stream.buf_count > 0) {
+    const uint32_t slot = _tx_stream.buf_tail;
+    const std::vector<uint32_t> &ends = _tx_stream.buf_burst_ends[slot];
+
+    // copy up to the next burst end in the slot, or the end of the slot
+    const bool burst_end = _tx_stream.tail_burst < ends.size();
+    const uint32_t stop =
+        burst_end ? ends[_tx_stream.tail_burst] : _tx_stream.buf_samps[slot];
+    const size_t n =
+        std::min<size_t>(want - filled, stop - _tx_stream.tail_offset);
+    memcpy(buffer + filled * BYTES_PER_SAMPLE,
+           _tx_stream.buf[slot] + _tx_stream.tail_offset * BYTES_PER_SAMPLE,
+           n * BYTES_PER_SAMPLE);
+    filled += n;
+    _tx_stream.tail_offset += n;
+    _tx_stream.queued -= n;
+    if (n > 0) _tx_stream.in_gap = false;
+    if (_tx_stream.tail_offset < stop) break;
+
+    if (burst_end) {
+      // burst ack, timed when its last transfer went to the board
+      _tx_stream.tail_burst++;
+      _tx_stream.in_gap = true;
+      if (_tx_stream.events.size() == HACKRF_MAX_STREAM_EVENTS) {
+        _tx_stream.events.pop_front();
       }
+      _tx_stream.events.push_back(StreamEvent(
+          0, SOAPY_SDR_END_BURST | SOAPY_SDR_HAS_TIME, HackRF_timeNs()));
+    }
+    if (_tx_stream.tail_offset == _tx_stream.buf_samps[slot] and
+        _tx_stream.tail_burst == ends.size()) {
+      _tx_stream.tail_offset = 0;
+      _tx_stream.tail_burst = 0;
+      _tx_stream.buf_tail = (_tx_stream.buf_tail + 1) % _tx_stream.buf_num;
+      _tx_stream.buf_count--;
     }
   }
+  if (filled < want) {
+    // with the ring empty between bursts the board keeps streaming zeros,
+    // that is not an underflow
+    memset(buffer + filled * BYTES_PER_SAMPLE, 0,
+           length - filled * BYTES_PER_SAMPLE);
+    if (not _tx_stream.in_gap) _tx_stream.underflow = true;
+  }
   _tx_buf_cond.notify_one();
+  lock.unlock();
+  if (freed) _tx_notify.signal();
 
   return (0);
 }
@@ -91,6 +345,7 @@ std::vector<std::string> SoapyHackRFDuplex::getStreamFormats(
 
   formats.push_back(SOAPY_SDR_CS8);
   formats.push_back(SOAPY_SDR_CS16);
+  formats.push_back(SOAPY_SDR_CF16);
   formats.push_back(SOAPY_SDR_CF32);
   formats.push_back(SOAPY_SDR_CF64);
 
@@ -123,6 +378,132 @@ SoapySDR::ArgInfoList SoapyHackRFDuplex::getStreamArgsInfo(
   buffersArg.type = SoapySDR::ArgInfo::INT;
   streamArgs.push_back(buffersArg);
 
+  SoapySDR::ArgInfo fillArg;
+  fillArg.key = "fill";
+  fillArg.value = "false";
+  fillArg.name = "Fill Mode";
+  fillArg.description =
+      "Block each read or write until all samples are transferred or the "
+      "timeout expires, as SOAPY_SDR_WAIT_TRIGGER does for a single call.";
+  fillArg.type = SoapySDR::ArgInfo::BOOL;
+  streamArgs.push_back(fillArg);
+
+  if (direction == SOAPY_SDR_RX) {
+    SoapySDR::ArgInfo buffersMinArg;
+    buffersMinArg.key = "buffers_min";
+    buffersMinArg.value = "2";
+    buffersMinArg.name = "Minimum Buffer Count";
+    buffersMinArg.description =
+        "Smallest depth of an adaptive RX ring, see buffers_max.";
+    buffersMinArg.units = "buffers";
+    buffersMinArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(buffersMinArg);
+
+    SoapySDR::ArgInfo buffersMaxArg;
+    buffersMaxArg.key = "buffers_max";
+    buffersMaxArg.value = "0";
+    buffersMaxArg.name = "Maximum Buffer Count";
+    buffersMaxArg.description =
+        "Above buffers_min, the RX ring grows on overflows and consumer lag "
+        "and shrinks when idle, between the two. See the rx_buffers and "
+        "rx_buffer_resizes settings.";
+    buffersMaxArg.units = "buffers";
+    buffersMaxArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(buffersMaxArg);
+
+    SoapySDR::ArgInfo overflowArg;
+    overflowArg.key = "overflow";
+    overflowArg.value = "drop_oldest";
+    overflowArg.name = "Overflow Policy";
+    overflowArg.description =
+        "What a full RX ring gives up: the oldest queued buffer, the newest "
+        "transfer, or nothing until the spill arena is full too. Reads "
+        "return SOAPY_SDR_OVERFLOW timed at the first lost sample, and "
+        "readStreamStatus and the rx_overflow_gaps setting report each gap.";
+    overflowArg.type = SoapySDR::ArgInfo::STRING;
+    overflowArg.options = {"drop_oldest", "drop_newest", "spill"};
+    streamArgs.push_back(overflowArg);
+
+    SoapySDR::ArgInfo spillArg;
+    spillArg.key = "spill_buffers";
+    spillArg.value = std::to_string(BUF_NUM);
+    spillArg.name = "Spill Arena Size";
+    spillArg.description =
+        "Buffers set aside for transfers that find the RX ring full, "
+        "allocated up front with the spill overflow policy.";
+    spillArg.units = "buffers";
+    spillArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(spillArg);
+  }
+
+  SoapySDR::ArgInfo standbyArg;
+  standbyArg.key = "standby";
+  standbyArg.value = "false";
+  standbyArg.name = "Hot Standby";
+  standbyArg.description =
+      "deactivateStream only pauses the stream: the board keeps streaming, "
+      "RX stops queueing and TX sends zeros, and activateStream resumes on "
+      "the next transfer. closeStream stops the board.";
+  standbyArg.type = SoapySDR::ArgInfo::BOOL;
+  streamArgs.push_back(standbyArg);
+
+  if (direction == SOAPY_SDR_TX) {
+    SoapySDR::ArgInfo prerollArg;
+    prerollArg.key = "preroll";
+    prerollArg.value = "0";
+    prerollArg.name = "TX Preroll";
+    prerollArg.description =
+        "Data queued before the TX board starts, as a buffer count or with "
+        "a us suffix as a duration. 0 starts at activation.";
+    prerollArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(prerollArg);
+
+    SoapySDR::ArgInfo cyclicArg;
+    cyclicArg.key = "cyclic";
+    cyclicArg.value = "false";
+    cyclicArg.name = "Cyclic Waveforms";
+    cyclicArg.description =
+        "writeStream uploads waveforms, each ended by END_BURST, which the "
+        "driver then transmits in a loop. See the tx_waveform settings.";
+    cyclicArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(cyclicArg);
+
+    SoapySDR::ArgInfo latencyArg;
+    latencyArg.key = "tx_latency_us";
+    latencyArg.value = "0";
+    latencyArg.name = "TX Latency Budget";
+    latencyArg.description =
+        "Bound the queued TX data to this duration at the board rate, but "
+        "never below one transfer; writes block or time out beyond it. 0 "
+        "queues up to the buffer count. Writing with SOAPY_SDR_USER_FLAG0 drops what is queued "
+        "first, as does the tx_flush setting.";
+    latencyArg.units = "us";
+    latencyArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(latencyArg);
+  }
+
+  if (direction == SOAPY_SDR_RX) {
+    SoapySDR::ArgInfo recordArg;
+    recordArg.key = "record_path";
+    recordArg.value = "";
+    recordArg.name = "Record Path";
+    recordArg.description =
+        "Also write the raw capture to this SigMF dataset from a driver "
+        "writer thread.";
+    recordArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(recordArg);
+  }
+
+  SoapySDR::ArgInfo scaleArg;
+  scaleArg.key = "scale";
+  scaleArg.value = "";
+  scaleArg.name = "Sample Scale";
+  scaleArg.description =
+      "Host sample value at CS8 full scale. Defaults to 32512 for CS16 and "
+      "1.0 for the float formats, ignored for CS8.";
+  scaleArg.type = SoapySDR::ArgInfo::FLOAT;
+  streamArgs.push_back(scaleArg);
+
   return streamArgs;
 }
 
@@ -130,7 +511,10 @@ void SoapyHackRFDuplex::Stream::allocate_buffers() {
   buf = (int8_t **)malloc(buf_num * sizeof(int8_t *));
   if (buf) {
     for (unsigned int i = 0; i < buf_num; ++i) {
-      buf[i] = (int8_t *)malloc(buf_len);
+      // page aligned so the buffers can be handed to O_DIRECT I/O
+      void *ptr = nullptr;
+      if (posix_memalign(&ptr, HACKRF_BUF_ALIGN, buf_len) != 0) ptr = nullptr;
+      buf[i] = (int8_t *)ptr;
     }
   }
 }
@@ -155,26 +539,58 @@ void SoapyHackRFDuplex::Stream::clear_buffers() {
   remainderHandle = -1;
 }
 
+/// Host sample value at CS8 full scale for the format, or the "scale" arg
+static float default_scale(uint32_t format) {
+  if (format == HACKRF_FORMAT_INT16) return 127.0f * 256.0f;
+  if (format == HACKRF_FORMAT_INT8) return 127.0f;
+  return 1.0f;
+}
+
+static float stream_scale(uint32_t format, const SoapySDR::Kwargs &args) {
+  if (args.count("scale") == 0 or format == HACKRF_FORMAT_INT8) {
+    return default_scale(format);
+  }
+
+  float scale = 0.0f;
+  try {
+    scale = std::stof(args.at("scale"));
+  } catch (const std::exception &) {
+  }
+  if (not std::isfinite(scale) or scale <= 0.0f) {
+    throw std::runtime_error("setupStream invalid scale " + args.at("scale"));
+  }
+  return scale;
+}
+
 SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
     const int direction, const std::string &format,
     const std::vector<size_t> &channels, const SoapySDR::Kwargs &args) {
-  if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0)) {
-    throw std::runtime_error("setupStream invalid channel selection");
-  }
-
   if (direction == SOAPY_SDR_RX) {
-    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    std::unique_lock<std::mutex> lock(_rx_device_mutex);
 
     if (_rx_stream.opened) {
       throw std::runtime_error("RX stream already opened");
     }
 
+    std::vector<size_t> stream_channels(channels);
+    if (stream_channels.empty()) stream_channels.push_back(0);
+    for (size_t i = 0; i < stream_channels.size(); ++i) {
+      if (stream_channels[i] >= _rx_num_channels or
+          std::count(stream_channels.begin(), stream_channels.end(),
+                     stream_channels[i]) > 1) {
+        throw std::runtime_error("setupStream invalid channel selection");
+      }
+    }
+
     if (format == SOAPY_SDR_CS8) {
       SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CS8.");
       _rx_stream.format = HACKRF_FORMAT_INT8;
     } else if (format == SOAPY_SDR_CS16) {
       SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CS16.");
       _rx_stream.format = HACKRF_FORMAT_INT16;
+    } else if (format == SOAPY_SDR_CF16) {
+      SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CF16.");
+      _rx_stream.format = HACKRF_FORMAT_FLOAT16;
     } else if (format == SOAPY_SDR_CF32) {
       SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CF32.");
       _rx_stream.format = HACKRF_FORMAT_FLOAT32;
@@ -184,6 +600,11 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
     } else
       throw std::runtime_error("setupStream invalid format " + format);
 
+    _rx_stream.scale = stream_scale(_rx_stream.format, args);
+    _rx_stream.fill =
+        args.count("fill") != 0 and args.at("fill") == "true";
+    _rx_stream.standby =
+        args.count("standby") != 0 and args.at("standby") == "true";
     _rx_stream.buf_num = BUF_NUM;
 
     if (args.count("buffers") != 0) {
@@ -195,12 +616,89 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
       } catch (const std::invalid_argument &) {
       }
     }
+
+    // an adaptive depth range, the ring starts at buffers within it
+    _rx_stream.buf_min = 2;
+    _rx_stream.buf_max = 0;
+    try {
+      if (args.count("buffers_min") != 0) {
+        _rx_stream.buf_min =
+            std::max(2, std::stoi(args.at("buffers_min")));
+      }
+      if (args.count("buffers_max") != 0) {
+        _rx_stream.buf_max = std::stoi(args.at("buffers_max"));
+      }
+    } catch (const std::exception &) {
+      throw std::runtime_error("setupStream invalid buffers_min/buffers_max");
+    }
+
+    HackRF_Overflow overflow_policy = HACKRF_OVERFLOW_DROP_OLDEST;
+    uint32_t spill_buffers = BUF_NUM;
+    if (args.count("overflow") != 0) {
+      const std::string &policy = args.at("overflow");
+      if (policy == "drop_newest") {
+        overflow_policy = HACKRF_OVERFLOW_DROP_NEWEST;
+      } else if (policy == "spill") {
+        overflow_policy = HACKRF_OVERFLOW_SPILL;
+      } else if (policy != "drop_oldest") {
+        throw std::runtime_error("setupStream invalid overflow " + policy);
+      }
+    }
+    try {
+      if (args.count("spill_buffers") != 0) {
+        spill_buffers = std::max(0, std::stoi(args.at("spill_buffers")));
+      }
+    } catch (const std::exception &) {
+      throw std::runtime_error("setupStream invalid spill_buffers");
+    }
+    if (_rx_stream.buf_max > _rx_stream.buf_min) {
+      _rx_stream.buf_num = std::min(
+          _rx_stream.buf_max, std::max(_rx_stream.buf_min, _rx_stream.buf_num));
+    }
+    {
+      std::lock_guard<std::mutex> buf_lock(_rx_buf_mutex);
+      _rx_stream.buf_target = _rx_stream.buf_num;
+      _rx_stream.window_count = 0;
+      _rx_stream.window_peak = 0;
+      _rx_stream.resizes.clear();
+      _rx_stream.overflow_policy = overflow_policy;
+      _rx_stream.gap_samps = 0;
+      _rx_stream.overflow_marks.clear();
+      _rx_stream.samples_lost = 0;
+      _rx_stream.gaps.clear();
+      _rx_stream.events.clear();
+      _rx_stream.allocate_spill(
+          overflow_policy == HACKRF_OVERFLOW_SPILL ? spill_buffers : 0);
+    }
     _rx_stream.allocate_buffers();
+    _rx_stream.buf_samps.assign(_rx_stream.buf_num,
+                                _rx_stream.buf_len / BYTES_PER_SAMPLE);
+    _rx_stream.buf_index.assign(_rx_stream.buf_num, 0);
+    _rx_stream.buf_time.assign(_rx_stream.buf_num, 0);
+    _rx_stream.buf_burst_end.assign(_rx_stream.buf_num, 0);
+
+    {
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      _rx_stream.stream_channels = stream_channels;
+      _rx_stream.dsp_in.resize(_rx_stream.buf_len);
+      _rx_stream.dsp_dirty = true;
+      _rx_stream.dsp_samps = 0;
+      _rx_stream.dsp_offset = 0;
+    }
 
     _rx_stream.opened = true;
+    lock.unlock();
+
+    if (args.count("record_path") != 0 and not args.at("record_path").empty()) {
+      this->start_recording(args.at("record_path"));
+    }
 
     return RX_STREAM;
   } else if (direction == SOAPY_SDR_TX) {
+    if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0)) {
+      throw std::runtime_error("setupStream invalid channel selection");
+    }
+
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
 
     if (_tx_stream.opened) {
@@ -213,6 +711,9 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
     } else if (format == SOAPY_SDR_CS16) {
       SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CS16.");
       _tx_stream.format = HACKRF_FORMAT_INT16;
+    } else if (format == SOAPY_SDR_CF16) {
+      SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CF16.");
+      _tx_stream.format = HACKRF_FORMAT_FLOAT16;
     } else if (format == SOAPY_SDR_CF32) {
       SoapySDR_log(SOAPY_SDR_DEBUG, "Using format CF32.");
       _tx_stream.format = HACKRF_FORMAT_FLOAT32;
@@ -222,6 +723,13 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
     } else
       throw std::runtime_error("setupStream invalid format " + format);
 
+    _tx_stream.scale = stream_scale(_tx_stream.format, args);
+    _tx_stream.fill =
+        args.count("fill") != 0 and args.at("fill") == "true";
+    _tx_stream.standby =
+        args.count("standby") != 0 and args.at("standby") == "true";
+    _tx_stream.cyclic =
+        args.count("cyclic") != 0 and args.at("cyclic") == "true";
     _tx_stream.buf_num = BUF_NUM;
 
     if (args.count("buffers") != 0) {
@@ -234,7 +742,55 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
       }
     }
 
+    _tx_stream.preroll = 0;
+    if (args.count("preroll") != 0 and not _tx_stream.cyclic) {
+      const std::string &preroll = args.at("preroll");
+      double preroll_in = 0.0;
+      try {
+        preroll_in = std::stod(preroll);
+      } catch (const std::exception &) {
+      }
+      if (preroll.size() > 2 and
+          preroll.compare(preroll.size() - 2, 2, "us") == 0) {
+        // whole transfers covering the duration at the board rate
+        const double buffer_us =
+            (_tx_stream.buf_len / BYTES_PER_SAMPLE) / _tx_stream.samplerate *
+            1e6;
+        preroll_in = buffer_us > 0 ? ceil(preroll_in / buffer_us) : 0;
+      }
+      if (preroll_in > 0) {
+        _tx_stream.preroll =
+            std::min<uint32_t>((uint32_t)preroll_in, _tx_stream.buf_num);
+      }
+    }
+    _tx_stream.start_pending = false;
+
+    _tx_stream.latency_us = 0;
+    if (args.count("tx_latency_us") != 0) {
+      try {
+        _tx_stream.latency_us = std::stol(args.at("tx_latency_us"));
+      } catch (const std::exception &) {
+        throw std::runtime_error("setupStream invalid tx_latency_us " +
+                                 args.at("tx_latency_us"));
+      }
+    }
+
     _tx_stream.allocate_buffers();
+    _tx_stream.buf_burst_ends.assign(_tx_stream.buf_num,
+                                     std::vector<uint32_t>());
+    _tx_stream.buf_samps.assign(_tx_stream.buf_num,
+                                _tx_stream.buf_len / BYTES_PER_SAMPLE);
+    {
+      std::lock_guard<std::mutex> buf_lock(_tx_buf_mutex);
+      _tx_stream.events.clear();
+      _tx_stream.in_gap = false;
+      _tx_stream.tail_offset = 0;
+      _tx_stream.tail_burst = 0;
+      _tx_stream.flush_pending = false;
+      _tx_stream.queued = 0;
+      _tx_stream.granted = 0;
+      _tx_stream.dropped = 0;
+    }
     _tx_stream.opened = true;
 
     return TX_STREAM;
@@ -244,23 +800,64 @@ SoapySDR::Stream *SoapyHackRFDuplex::setupStream(
 }
 
 void SoapyHackRFDuplex::closeStream(SoapySDR::Stream *stream) {
+  // a recording started with the stream ends with it
+  if (stream == RX_STREAM and _recorder.active and not _recorder.owns_rx) {
+    this->stop_recording();
+  }
+
+  // a standby stream is stopped for real
+  if (stream == RX_STREAM) {
+    std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    _rx_stream.standby = false;
+  } else if (stream == TX_STREAM) {
+    std::lock_guard<std::mutex> lock(_tx_device_mutex);
+    _tx_stream.standby = false;
+  }
   this->deactivateStream(stream, 0, 0);
   if (stream == RX_STREAM) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
+    {
+      std::lock_guard<std::mutex> buf_lock(_rx_buf_mutex);
+      _rx_stream.clear_spill();
+    }
     _rx_stream.clear_buffers();
+    _rx_stream.overflow = false;
+    {
+      std::lock_guard<std::mutex> dsp_lock(_rx_dsp_mutex);
+      _rx_stream.stream_channels.clear();
+      _rx_stream.dsp_in.clear();
+      _rx_stream.dsp_out.clear();
+      _rx_stream.dsp_samps = 0;
+      _rx_stream.dsp_offset = 0;
+    }
     _rx_stream.opened = false;
   } else if (stream == TX_STREAM) {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
     _tx_stream.clear_buffers();
+    _tx_stream.cyclic = false;
     _tx_stream.opened = false;
   }
 }
 
 size_t SoapyHackRFDuplex::getStreamMTU(SoapySDR::Stream *stream) const {
   if (stream == RX_STREAM) {
+    std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+    if (_rx_stream.dsp_wanted) {
+      // DDC output of one wideband buffer
+      const RXChannel &ch =
+          _rx_stream.channels[_rx_stream.stream_channels.empty()
+                                  ? 0
+                                  : _rx_stream.stream_channels[0]];
+      return (size_t)ceil(_rx_stream.buf_len / BYTES_PER_SAMPLE / ch.decim *
+                          ch.ratio) +
+             2;
+    }
     return _rx_stream.buf_len / BYTES_PER_SAMPLE;
   } else if (stream == TX_STREAM) {
-    return _tx_stream.buf_len / BYTES_PER_SAMPLE;
+    // input samples that fill one transfer after interpolation
+    std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+    return (size_t)(_tx_stream.buf_len / BYTES_PER_SAMPLE /
+                    _tx_stream.interp / _tx_stream.ratio);
   } else {
     throw std::runtime_error("Invalid stream");
   }
@@ -272,14 +869,19 @@ int SoapyHackRFDuplex::activateStream(SoapySDR::Stream *stream, const int flags,
   if (stream == RX_STREAM) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
 
-    if (_rx_active == HACKRF_TRANSCEIVER_MODE_ON) return 0;
-
-    if (_rx_active == HACKRF_TRANSCEIVER_MODE_OFF) {
-      if (_tx_stream.burst_end) {
-        while (hackrf_is_streaming(_rx_dev) == HACKRF_TRUE)
-          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // a running or standby stream only has its acquisition window (re)armed
+    if (_rx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+      const int ret = this->arm_rx_acquisition(flags, timeNs, numElems);
+      if (ret < 0) return ret;
+      if (_rx_stream.paused) {
+        _rx_stream.paused = false;
+        this->start_stream_worker(RX_STREAM);
       }
+      return 0;
+    }
+    _rx_stream.paused = false;
 
+    if (_rx_active == HACKRF_TRANSCEIVER_MODE_OFF) {
       // TODO: Check if this is required now
       // hackrf_stop_tx(_rx_dev);
 
@@ -332,12 +934,25 @@ int SoapyHackRFDuplex::activateStream(SoapySDR::Stream *stream, const int flags,
 
     // reset buffer tracking before streaming
     {
+      std::lock_guard<std::mutex> buf_lock(_rx_buf_mutex);
       _rx_stream.buf_count = 0;
       _rx_stream.buf_head = 0;
       _rx_stream.buf_tail = 0;
+      _rx_stream.buf_held = 0;
+      _rx_stream.remainderHandle = -1;
+      _rx_stream.sample_index = 0;
+      _rx_stream.start_time_ns = HackRF_timeNs();
+      _rx_stream.history_pending = 0;
+      _rx_stream.squelch_hold = 0;
+      _rx_stream.squelch_open = false;
+      this->drop_rx_spill();
+      _rx_stream.gap_samps = 0;
+      _rx_stream.overflow_marks.clear();
     }
+    int ret = this->arm_rx_acquisition(flags, timeNs, numElems);
+    if (ret < 0) return ret;
 
-    int ret = hackrf_start_rx(_rx_dev, _hackrf_rx_callback, (void *)this);
+    ret = hackrf_start_rx(_rx_dev, _hackrf_rx_callback, (void *)this);
     if (ret != HACKRF_SUCCESS) {
       SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_start_rx() failed -- %s",
                      hackrf_error_name(hackrf_error(ret)));
@@ -366,113 +981,221 @@ int SoapyHackRFDuplex::activateStream(SoapySDR::Stream *stream, const int flags,
     }
 
     _rx_active = HACKRF_TRANSCEIVER_MODE_ON;
+    this->start_stream_worker(RX_STREAM);
 
   } else if (stream == TX_STREAM) {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
 
-    if ((flags & SOAPY_SDR_END_BURST) != 0 and numElems != 0) {
-      if (_tx_active == HACKRF_TRANSCEIVER_MODE_OFF) {
-        _tx_stream.buf_head = 0;
-        _tx_stream.buf_tail = 0;
-        _tx_stream.burst_end = true;
-        _tx_stream.burst_samps = numElems;
+    if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+      if (_tx_stream.paused) {
+        _tx_stream.paused = false;
+        this->start_stream_worker(TX_STREAM);
       }
+      return 0;
     }
-
-    if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) return 0;
-
-    if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) {
-      // TODO: Check if this is required now
-      // hackrf_stop_rx(_dev);
-
-      // determine what (if any) settings  need to be changed for TX; only
-      // applicable if there is both a source and sink block sample_rate
-      if (_tx_current_samplerate != _tx_stream.samplerate) {
-        _tx_current_samplerate = _tx_stream.samplerate;
-        SoapySDR_logf(SOAPY_SDR_DEBUG,
-                      "activateStream - Set TX samplerate to %f",
-                      _tx_current_samplerate);
-        hackrf_set_sample_rate(_tx_dev, _tx_current_samplerate);
+    _tx_stream.paused = false;
+
+    if (_tx_stream.preroll > 0) {
+      std::lock_guard<std::mutex> buf_lock(_tx_buf_mutex);
+      if (_tx_stream.buf_count < _tx_stream.preroll) {
+        // releaseWriteBuffer starts the board once the preroll is queued
+        _tx_stream.start_pending = true;
+        this->start_stream_worker(TX_STREAM);
+        return 0;
       }
+    }
 
-      // frequency
-      if (_tx_current_frequency != _tx_stream.frequency) {
-        _tx_current_frequency = _tx_stream.frequency;
-        SoapySDR_logf(SOAPY_SDR_DEBUG,
-                      "activateStream - Set TX frequency to %lu",
-                      _tx_current_frequency);
-        hackrf_set_freq(_tx_dev, _tx_current_frequency);
-      }
+    return this->start_tx();
+  }
 
-      // frequency_correction; assume RX and TX use the same correction
-      // This will be the setting of whichever block was last added to the flow
-      // graph
+  return (0);
+}
 
-      // RF Gain (RF Amp for TX & RX)
-      if (_tx_current_amp != _tx_stream.amp_gain) {
-        _tx_current_amp = _tx_stream.amp_gain;
-        SoapySDR_logf(SOAPY_SDR_DEBUG, "activateStream - Set TX amp gain to %d",
-                      _tx_current_amp);
-        hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
-      }
+int SoapyHackRFDuplex::start_tx(void) {
+  if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+    // TODO: Check if this is required now
+    // hackrf_stop_rx(_dev);
 
-      // IF Gain (LNA for RX, VGA_TX for TX)
-      // BB Gain (VGA for RX, n/a for TX)
-      // These are independant values in the hackrf, so no need to change
+    // determine what (if any) settings  need to be changed for TX; only
+    // applicable if there is both a source and sink block sample_rate
+    if (_tx_current_samplerate != _tx_stream.samplerate) {
+      _tx_current_samplerate = _tx_stream.samplerate;
+      SoapySDR_logf(SOAPY_SDR_DEBUG,
+                    "activateStream - Set TX samplerate to %f",
+                    _tx_current_samplerate);
+      hackrf_set_sample_rate(_tx_dev, _tx_current_samplerate);
+    }
 
-      // Bandwidth
-      if (_tx_current_bandwidth != _tx_stream.bandwidth) {
-        _tx_current_bandwidth = _tx_stream.bandwidth;
-        SoapySDR_logf(SOAPY_SDR_DEBUG,
-                      "activateStream - Set RX bandwidth to %d",
-                      _tx_current_bandwidth);
-        hackrf_set_baseband_filter_bandwidth(_tx_dev, _tx_current_bandwidth);
-      }
+    // frequency
+    if (_tx_current_frequency != _tx_stream.frequency) {
+      _tx_current_frequency = _tx_stream.frequency;
+      SoapySDR_logf(SOAPY_SDR_DEBUG,
+                    "activateStream - Set TX frequency to %lu",
+                    _tx_current_frequency);
+      hackrf_set_freq(_tx_dev, _tx_current_frequency);
     }
 
-    SoapySDR_logf(SOAPY_SDR_DEBUG, "Start TX");
+    // frequency_correction; assume RX and TX use the same correction
+    // This will be the setting of whichever block was last added to the flow
+    // graph
 
-    int ret = hackrf_start_tx(_tx_dev, _hackrf_tx_callback, (void *)this);
-    if (ret != HACKRF_SUCCESS) {
-      SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_start_tx() failed -- %s",
-                     hackrf_error_name(hackrf_error(ret)));
+    // RF Gain (RF Amp for TX & RX)
+    if (_tx_current_amp != _tx_stream.amp_gain) {
+      _tx_current_amp = _tx_stream.amp_gain;
+      SoapySDR_logf(SOAPY_SDR_DEBUG, "activateStream - Set TX amp gain to %d",
+                    _tx_current_amp);
+      hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
     }
 
-    ret = hackrf_is_streaming(_tx_dev);
+    // IF Gain (LNA for RX, VGA_TX for TX)
+    // BB Gain (VGA for RX, n/a for TX)
+    // These are independant values in the hackrf, so no need to change
 
-    if (ret == HACKRF_ERROR_STREAMING_EXIT_CALLED) {
-      hackrf_close(_tx_dev);
-      hackrf_open_by_serial(_tx_serial.c_str(), &_tx_dev);
-      _tx_current_frequency = _tx_stream.frequency;
-      hackrf_set_freq(_tx_dev, _tx_current_frequency);
-      _tx_current_samplerate = _tx_stream.samplerate;
-      hackrf_set_sample_rate(_tx_dev, _tx_current_samplerate);
+    // Bandwidth
+    if (_tx_current_bandwidth != _tx_stream.bandwidth) {
       _tx_current_bandwidth = _tx_stream.bandwidth;
+      SoapySDR_logf(SOAPY_SDR_DEBUG,
+                    "activateStream - Set RX bandwidth to %d",
+                    _tx_current_bandwidth);
       hackrf_set_baseband_filter_bandwidth(_tx_dev, _tx_current_bandwidth);
-      _tx_current_amp = _rx_stream.amp_gain;
-      hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
-      hackrf_set_txvga_gain(_tx_dev, _tx_stream.vga_gain);
-      hackrf_set_antenna_enable(_tx_dev, _tx_stream.bias);
-      hackrf_start_tx(_tx_dev, _hackrf_tx_callback, (void *)this);
-      ret = hackrf_is_streaming(_tx_dev);
-    } else if (ret != HACKRF_TRUE) {
-      SoapySDR_logf(SOAPY_SDR_ERROR, "Activate TX Stream Failed.");
-      return SOAPY_SDR_STREAM_ERROR;
     }
+  }
 
-    _tx_active = HACKRF_TRANSCEIVER_MODE_ON;
+  SoapySDR_logf(SOAPY_SDR_DEBUG, "Start TX");
+
+  int ret = hackrf_start_tx(_tx_dev, _hackrf_tx_callback, (void *)this);
+  if (ret != HACKRF_SUCCESS) {
+    SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_start_tx() failed -- %s",
+                   hackrf_error_name(hackrf_error(ret)));
   }
 
+  ret = hackrf_is_streaming(_tx_dev);
+
+  if (ret == HACKRF_ERROR_STREAMING_EXIT_CALLED) {
+    hackrf_close(_tx_dev);
+    hackrf_open_by_serial(_tx_serial.c_str(), &_tx_dev);
+    _tx_current_frequency = _tx_stream.frequency;
+    hackrf_set_freq(_tx_dev, _tx_current_frequency);
+    _tx_current_samplerate = _tx_stream.samplerate;
+    hackrf_set_sample_rate(_tx_dev, _tx_current_samplerate);
+    _tx_current_bandwidth = _tx_stream.bandwidth;
+    hackrf_set_baseband_filter_bandwidth(_tx_dev, _tx_current_bandwidth);
+    _tx_current_amp = _rx_stream.amp_gain;
+    hackrf_set_amp_enable(_tx_dev, (_tx_current_amp > 0) ? 1 : 0);
+    hackrf_set_txvga_gain(_tx_dev, _tx_stream.vga_gain);
+    hackrf_set_antenna_enable(_tx_dev, _tx_stream.bias);
+    hackrf_start_tx(_tx_dev, _hackrf_tx_callback, (void *)this);
+    ret = hackrf_is_streaming(_tx_dev);
+  } else if (ret != HACKRF_TRUE) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "Activate TX Stream Failed.");
+    return SOAPY_SDR_STREAM_ERROR;
+  }
+
+  _tx_active = HACKRF_TRANSCEIVER_MODE_ON;
+
+  {
+    std::lock_guard<std::mutex> buf_lock(_tx_buf_mutex);
+    _tx_stream.start_pending = false;
+    _tx_stream.start_time_ns = HackRF_timeNs();
+    _tx_stream.in_gap = false;
+    if (_tx_stream.events.size() == HACKRF_MAX_STREAM_EVENTS) {
+      _tx_stream.events.pop_front();
+    }
+    _tx_stream.events.push_back(
+        StreamEvent(0, SOAPY_SDR_HAS_TIME, _tx_stream.start_time_ns));
+  }
+  this->start_stream_worker(TX_STREAM);
+
   return (0);
 }
 
+/*
+ * Finite RX acquisitions. activateStream() with END_BURST and numElems arms
+ * a window of numElems samples from timeNs (HAS_TIME) or from the next
+ * transfer, preceded by up to acquire_pre samples of history. The board
+ * keeps streaming between acquisitions so re-arming a running stream takes
+ * effect on the next transfer and the history stays full; deactivateStream()
+ * stops it. Activating without END_BURST goes back to continuous streaming.
+ */
+int SoapyHackRFDuplex::arm_rx_acquisition(const int flags,
+                                          const long long timeNs,
+                                          const size_t numElems) {
+  const bool finite = (flags & SOAPY_SDR_END_BURST) and numElems > 0;
+  if (not finite and not _rx_stream.acq) return 0;
+
+  // board samples per stream sample when the channelizer is in the path;
+  // nothing is left part read below, so the next read takes dsp_wanted
+  bool dsp = false;
+  double per_elem = 1.0;
+  {
+    std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+    dsp = _rx_stream.dsp_wanted;
+    if (dsp) {
+      const RXChannel &ch = _rx_stream.channels[_rx_stream.stream_channels[0]];
+      per_elem = ch.decim / ch.ratio;
+    }
+  }
+
+  // nothing read before the acquisition belongs to it
+  if (_rx_stream.remainderHandle >= 0) {
+    this->releaseReadBuffer(RX_STREAM, _rx_stream.remainderHandle);
+    _rx_stream.remainderHandle = -1;
+    _rx_stream.remainderOffset = 0;
+    _rx_stream.remainderSamps = 0;
+  }
+  _rx_stream.dsp_offset = _rx_stream.dsp_samps;
+  _rx_stream.acq_limit = finite and dsp;
+  _rx_stream.acq_left = numElems;
+  _rx_stream.acq_discard = false;
+
+  std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+  const uint32_t ready = _rx_stream.buf_count - _rx_stream.buf_held;
+  _rx_stream.buf_head = (_rx_stream.buf_head + ready) % _rx_stream.buf_num;
+  _rx_stream.buf_count -= ready;
+  this->drop_rx_spill();
+
+  if (not finite) {
+    _rx_stream.acq = false;
+    _rx_stream.history_pending = 0;
+    return 0;
+  }
+
+  uint64_t trigger = _rx_stream.sample_index;
+  if (flags & SOAPY_SDR_HAS_TIME) {
+    const long long delta = timeNs - _rx_stream.start_time_ns;
+    trigger = delta > 0 ? (uint64_t)(delta * 1e-9 * _rx_stream.samplerate) : 0;
+  }
+  // the filters need a few extra samples to produce numElems outputs
+  const uint64_t samps =
+      (uint64_t)std::ceil((dsp ? numElems + 4 : numElems) * per_elem);
+  if (trigger + samps <= _rx_stream.sample_index) {
+    SoapySDR_logf(SOAPY_SDR_ERROR, "RX acquisition window already passed");
+    return SOAPY_SDR_TIME_ERROR;
+  }
+
+  _rx_stream.acq_start = trigger - std::min(trigger, _rx_stream.acq_pre);
+  _rx_stream.acq_end = trigger + samps;
+  _rx_stream.acq = true;
+  return 0;
+}
+
 int SoapyHackRFDuplex::deactivateStream(SoapySDR::Stream *stream,
                                         const int flags,
                                         const long long timeNs) {
+  // the worker may be waiting on the device mutex, stop it first
+  if (stream == RX_STREAM or stream == TX_STREAM) {
+    this->stop_stream_worker(stream);
+  }
+
   if (stream == RX_STREAM) {
     std::lock_guard<std::mutex> lock(_rx_device_mutex);
 
-    if (_rx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+    if (_rx_active == HACKRF_TRANSCEIVER_MODE_ON and _rx_stream.standby) {
+      // keep the transfers running so activation is immediate and the
+      // sample index stays continuous
+      _rx_stream.paused = true;
+    } else if (_rx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+      _rx_stream.paused = false;
       int ret = hackrf_stop_rx(_rx_dev);
       if (ret != HACKRF_SUCCESS) {
         SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_stop_rx() failed -- %s",
@@ -482,8 +1205,12 @@ int SoapyHackRFDuplex::deactivateStream(SoapySDR::Stream *stream,
     }
   } else if (stream == TX_STREAM) {
     std::lock_guard<std::mutex> lock(_tx_device_mutex);
+    _tx_stream.start_pending = false;
 
-    if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+    if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON and _tx_stream.standby) {
+      _tx_stream.paused = true;
+    } else if (_tx_active == HACKRF_TRANSCEIVER_MODE_ON) {
+      _tx_stream.paused = false;
       int ret = hackrf_stop_tx(_tx_dev);
       if (ret != HACKRF_SUCCESS) {
         SoapySDR::logf(SOAPY_SDR_ERROR, "hackrf_stop_tx() failed -- %s",
@@ -495,38 +1222,102 @@ int SoapyHackRFDuplex::deactivateStream(SoapySDR::Stream *stream,
   return (0);
 }
 
+/*
+ * Sample format conversion. scale is the host value that corresponds to CS8
+ * full scale (127), see stream_scale(). CS8 is the native format and always
+ * passes through untouched. The loops run over the flat interleaved arrays so
+ * the compiler can vectorize them, and CF16 goes through a block of floats
+ * small enough to stay in L1.
+ */
+#define HACKRF_CONV_BLOCK 512
+
+static void float_to_cs8(const float *src, int8_t *dst, size_t count,
+                         float gain) {
+  for (size_t i = 0; i < count; ++i) {
+    float v = src[i] * gain;
+    v = v > 127.0f ? 127.0f : (v < -128.0f ? -128.0f : v);
+    dst[i] = (int8_t)lrintf(v);
+  }
+}
+
 void readbuf(int8_t *src, void *dst, uint32_t len, uint32_t format,
-             size_t offset) {
+             size_t offset, float scale) {
+  const size_t count = (size_t)len * BYTES_PER_SAMPLE;
   if (format == HACKRF_FORMAT_INT8) {
     int8_t *samples_cs8 = (int8_t *)dst + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      samples_cs8[i * BYTES_PER_SAMPLE] = src[i * BYTES_PER_SAMPLE];
-      samples_cs8[i * BYTES_PER_SAMPLE + 1] = src[i * BYTES_PER_SAMPLE + 1];
+    memcpy(samples_cs8, src, count);
+  } else if (format == HACKRF_FORMAT_INT16) {
+    int16_t *samples_cs16 = (int16_t *)dst + offset * BYTES_PER_SAMPLE;
+    if (scale == default_scale(format)) {
+      for (size_t i = 0; i < count; ++i) {
+        samples_cs16[i] = (int16_t)(src[i] * 256);
+      }
+    } else {
+      const float gain = scale / 127.0f;
+      for (size_t i = 0; i < count; ++i) {
+        float v = src[i] * gain;
+        v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+        samples_cs16[i] = (int16_t)lrintf(v);
+      }
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT32) {
+    float *samples_cf32 = (float *)dst + offset * BYTES_PER_SAMPLE;
+    const float gain = scale / 127.0f;
+    for (size_t i = 0; i < count; ++i) {
+      samples_cf32[i] = src[i] * gain;
     }
+  } else if (format == HACKRF_FORMAT_FLOAT64) {
+    double *samples_cf64 = (double *)dst + offset * BYTES_PER_SAMPLE;
+    const double gain = scale / 127.0;
+    for (size_t i = 0; i < count; ++i) {
+      samples_cf64[i] = src[i] * gain;
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT16) {
+    uint16_t *samples_cf16 = (uint16_t *)dst + offset * BYTES_PER_SAMPLE;
+    HackRF_cs8_to_cf16(src, samples_cf16, len, scale / 127.0f);
+  } else {
+    SoapySDR_log(SOAPY_SDR_ERROR, "read format not support");
+  }
+}
 
+void readbuf(const float *src, void *dst, uint32_t len, uint32_t format,
+             size_t offset, float scale) {
+  const size_t count = (size_t)len * BYTES_PER_SAMPLE;
+  if (format == HACKRF_FORMAT_INT8) {
+    int8_t *samples_cs8 = (int8_t *)dst + offset * BYTES_PER_SAMPLE;
+    float_to_cs8(src, samples_cs8, count, 127.0f);
   } else if (format == HACKRF_FORMAT_INT16) {
     int16_t *samples_cs16 = (int16_t *)dst + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      samples_cs16[i * BYTES_PER_SAMPLE] =
-          (int16_t)(src[i * BYTES_PER_SAMPLE] << 8);
-      samples_cs16[i * BYTES_PER_SAMPLE + 1] =
-          (int16_t)(src[i * BYTES_PER_SAMPLE + 1] << 8);
+    for (size_t i = 0; i < count; ++i) {
+      float v = src[i] * scale;
+      v = v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v);
+      samples_cs16[i] = (int16_t)lrintf(v);
     }
   } else if (format == HACKRF_FORMAT_FLOAT32) {
     float *samples_cf32 = (float *)dst + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      samples_cf32[i * BYTES_PER_SAMPLE] =
-          (float)(src[i * BYTES_PER_SAMPLE] / 127.0);
-      samples_cf32[i * BYTES_PER_SAMPLE + 1] =
-          (float)(src[i * BYTES_PER_SAMPLE + 1] / 127.0);
+    if (scale == 1.0f) {
+      memcpy(samples_cf32, src, count * sizeof(float));
+    } else {
+      for (size_t i = 0; i < count; ++i) {
+        samples_cf32[i] = src[i] * scale;
+      }
     }
   } else if (format == HACKRF_FORMAT_FLOAT64) {
     double *samples_cf64 = (double *)dst + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      samples_cf64[i * BYTES_PER_SAMPLE] =
-          (double)(src[i * BYTES_PER_SAMPLE] / 127.0);
-      samples_cf64[i * BYTES_PER_SAMPLE + 1] =
-          (double)(src[i * BYTES_PER_SAMPLE + 1] / 127.0);
+    for (size_t i = 0; i < count; ++i) {
+      samples_cf64[i] = (double)src[i] * scale;
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT16) {
+    uint16_t *samples_cf16 = (uint16_t *)dst + offset * BYTES_PER_SAMPLE;
+    if (scale == 1.0f) {
+      HackRF_f32_to_f16(src, samples_cf16, count);
+    } else {
+      float block[HACKRF_CONV_BLOCK];
+      for (size_t i = 0; i < count; i += HACKRF_CONV_BLOCK) {
+        const size_t n = std::min<size_t>(HACKRF_CONV_BLOCK, count - i);
+        for (size_t j = 0; j < n; ++j) block[j] = src[i + j] * scale;
+        HackRF_f32_to_f16(block, samples_cf16 + i, n);
+      }
     }
   } else {
     SoapySDR_log(SOAPY_SDR_ERROR, "read format not support");
@@ -534,107 +1325,374 @@ void readbuf(int8_t *src, void *dst, uint32_t len, uint32_t format,
 }
 
 void writebuf(const void *src, int8_t *dst, uint32_t len, uint32_t format,
-              size_t offset) {
+              size_t offset, float scale) {
+  const size_t count = (size_t)len * BYTES_PER_SAMPLE;
   if (format == HACKRF_FORMAT_INT8) {
-    int8_t *samples_cs8 = (int8_t *)src + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      dst[i * BYTES_PER_SAMPLE] = samples_cs8[i * BYTES_PER_SAMPLE];
-      dst[i * BYTES_PER_SAMPLE + 1] = samples_cs8[i * BYTES_PER_SAMPLE + 1];
+    const int8_t *samples_cs8 = (const int8_t *)src + offset * BYTES_PER_SAMPLE;
+    memcpy(dst, samples_cs8, count);
+  } else if (format == HACKRF_FORMAT_INT16) {
+    const int16_t *samples_cs16 =
+        (const int16_t *)src + offset * BYTES_PER_SAMPLE;
+    if (scale == default_scale(format)) {
+      for (size_t i = 0; i < count; ++i) {
+        dst[i] = (int8_t)(samples_cs16[i] >> 8);
+      }
+    } else {
+      const float gain = 127.0f / scale;
+      for (size_t i = 0; i < count; ++i) {
+        float v = samples_cs16[i] * gain;
+        v = v > 127.0f ? 127.0f : (v < -128.0f ? -128.0f : v);
+        dst[i] = (int8_t)lrintf(v);
+      }
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT32) {
+    const float *samples_cf32 = (const float *)src + offset * BYTES_PER_SAMPLE;
+    float_to_cs8(samples_cf32, dst, count, 127.0f / scale);
+  } else if (format == HACKRF_FORMAT_FLOAT64) {
+    const double *samples_cf64 =
+        (const double *)src + offset * BYTES_PER_SAMPLE;
+    const double gain = 127.0 / scale;
+    for (size_t i = 0; i < count; ++i) {
+      double v = samples_cf64[i] * gain;
+      v = v > 127.0 ? 127.0 : (v < -128.0 ? -128.0 : v);
+      dst[i] = (int8_t)lrint(v);
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT16) {
+    const uint16_t *samples_cf16 =
+        (const uint16_t *)src + offset * BYTES_PER_SAMPLE;
+    float block[HACKRF_CONV_BLOCK];
+    for (size_t i = 0; i < count; i += HACKRF_CONV_BLOCK) {
+      const size_t n = std::min<size_t>(HACKRF_CONV_BLOCK, count - i);
+      HackRF_f16_to_f32(samples_cf16 + i, block, n);
+      float_to_cs8(block, dst + i, n, 127.0f / scale);
     }
+  } else {
+    SoapySDR_log(SOAPY_SDR_ERROR, "write format not support");
+  }
+}
 
+void writebuf(const void *src, float *dst, uint32_t len, uint32_t format,
+              size_t offset, float scale) {
+  const size_t count = (size_t)len * BYTES_PER_SAMPLE;
+  if (format == HACKRF_FORMAT_INT8) {
+    HackRF_cs8_to_cf32((const int8_t *)src + offset * BYTES_PER_SAMPLE, dst,
+                       len);
   } else if (format == HACKRF_FORMAT_INT16) {
-    int16_t *samples_cs16 = (int16_t *)src + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      dst[i * BYTES_PER_SAMPLE] =
-          (int8_t)(samples_cs16[i * BYTES_PER_SAMPLE] >> 8);
-      dst[i * BYTES_PER_SAMPLE + 1] =
-          (int8_t)(samples_cs16[i * BYTES_PER_SAMPLE + 1] >> 8);
+    const int16_t *samples_cs16 =
+        (const int16_t *)src + offset * BYTES_PER_SAMPLE;
+    const float gain = 1.0f / scale;
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = samples_cs16[i] * gain;
     }
   } else if (format == HACKRF_FORMAT_FLOAT32) {
-    float *samples_cf32 = (float *)src + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      dst[i * BYTES_PER_SAMPLE] =
-          (int8_t)(samples_cf32[i * BYTES_PER_SAMPLE] * 127.0);
-      dst[i * BYTES_PER_SAMPLE + 1] =
-          (int8_t)(samples_cf32[i * BYTES_PER_SAMPLE + 1] * 127.0);
+    const float *samples_cf32 = (const float *)src + offset * BYTES_PER_SAMPLE;
+    if (scale == 1.0f) {
+      memcpy(dst, samples_cf32, count * sizeof(float));
+    } else {
+      const float gain = 1.0f / scale;
+      for (size_t i = 0; i < count; ++i) {
+        dst[i] = samples_cf32[i] * gain;
+      }
     }
   } else if (format == HACKRF_FORMAT_FLOAT64) {
-    double *samples_cf64 = (double *)src + offset * BYTES_PER_SAMPLE;
-    for (uint32_t i = 0; i < len; ++i) {
-      dst[i * BYTES_PER_SAMPLE] =
-          (int8_t)(samples_cf64[i * BYTES_PER_SAMPLE] * 127.0);
-      dst[i * BYTES_PER_SAMPLE + 1] =
-          (int8_t)(samples_cf64[i * BYTES_PER_SAMPLE + 1] * 127.0);
+    const double *samples_cf64 =
+        (const double *)src + offset * BYTES_PER_SAMPLE;
+    const double gain = 1.0 / scale;
+    for (size_t i = 0; i < count; ++i) {
+      dst[i] = samples_cf64[i] * gain;
+    }
+  } else if (format == HACKRF_FORMAT_FLOAT16) {
+    const uint16_t *samples_cf16 =
+        (const uint16_t *)src + offset * BYTES_PER_SAMPLE;
+    HackRF_f16_to_f32(samples_cf16, dst, count);
+    if (scale != 1.0f) {
+      const float gain = 1.0f / scale;
+      for (size_t i = 0; i < count; ++i) {
+        dst[i] *= gain;
+      }
     }
-
   } else {
     SoapySDR_log(SOAPY_SDR_ERROR, "write format not support");
   }
 }
 
+/// Time left until deadline for a fill mode call, never negative
+static long remaining_us(
+    const std::chrono::steady_clock::time_point &deadline) {
+  const long long us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           deadline - std::chrono::steady_clock::now())
+                           .count();
+  return us > 0 ? (long)us : 0;
+}
+
 int SoapyHackRFDuplex::readStream(SoapySDR::Stream *stream, void *const *buffs,
                                   const size_t numElems, int &flags,
                                   long long &timeNs, const long timeoutUs) {
   if (stream != RX_STREAM) {
     return SOAPY_SDR_NOT_SUPPORTED;
   }
-  /* this is the user's buffer for channel 0 */
-  size_t returnedElems = std::min(numElems, this->getStreamMTU(stream));
 
+  // fill mode keeps waiting for buffers until numElems are read or the
+  // timeout runs out, otherwise only the first buffer is waited for and
+  // the call drains whatever else is already queued
+  const bool fill = _rx_stream.fill or (flags & SOAPY_SDR_WAIT_TRIGGER);
+  flags &= ~SOAPY_SDR_WAIT_TRIGGER;
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+
+  if (this->sync_rx_path() or _rx_stream.dsp_offset < _rx_stream.dsp_samps) {
+    return this->read_stream_dsp(buffs, numElems, flags, timeNs, timeoutUs,
+                                 fill, deadline);
+  }
+
+  /* this is the user's buffer for channel 0 */
   size_t samp_avail = 0;
+  uint64_t next_index = 0;
+
+  while (samp_avail < numElems) {
+    if (_rx_stream.remainderHandle < 0) {
+      const long wait =
+          samp_avail == 0 ? timeoutUs : (fill ? remaining_us(deadline) : 0);
+      size_t handle;
+      int buf_flags = 0;
+      long long buf_time = 0;
+      int ret = this->acquireReadBuffer(
+          stream, handle, (const void **)&_rx_stream.remainderBuff, buf_flags,
+          buf_time, wait);
+      if (ret < 0) {
+        if (samp_avail == 0) {
+          flags |= buf_flags;
+          if (buf_flags & SOAPY_SDR_HAS_TIME) timeNs = buf_time;
+          return ret;
+        }
+        if (ret == SOAPY_SDR_OVERFLOW) {
+          // report it on the next call, after the samples already read
+          std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+          _rx_stream.overflow = true;
+        }
+        break;
+      }
+      _rx_stream.remainderHandle = handle;
+      _rx_stream.remainderSamps = ret;
+      _rx_stream.remainderOffset = 0;
+      _rx_stream.remainder_index = _rx_stream.buf_index[handle];
+      _rx_stream.remainder_time = buf_time;
+      _rx_stream.remainder_burst_end = (buf_flags & SOAPY_SDR_END_BURST) != 0;
 
-  if (_rx_stream.remainderHandle >= 0) {
-    const size_t n = std::min(_rx_stream.remainderSamps, returnedElems);
+      // a squelch gap, the buffer starts the next call
+      if (samp_avail > 0 and _rx_stream.remainder_index != next_index) break;
+    }
 
-    if (n < returnedElems) {
-      samp_avail = n;
+    if (samp_avail == 0) {
+      timeNs = _rx_stream.remainder_time;
+      if (_rx_stream.samplerate > 0) {
+        timeNs += (long long)(_rx_stream.remainderOffset * 1e9 /
+                              _rx_stream.samplerate);
+      }
+      flags |= SOAPY_SDR_HAS_TIME;
     }
 
+    const size_t n =
+        std::min(numElems - samp_avail, _rx_stream.remainderSamps);
+
     readbuf(_rx_stream.remainderBuff +
                 _rx_stream.remainderOffset * BYTES_PER_SAMPLE,
-            buffs[0], n, _rx_stream.format, 0);
-
+            buffs[0], n, _rx_stream.format, samp_avail, _rx_stream.scale);
+    samp_avail += n;
     _rx_stream.remainderOffset += n;
     _rx_stream.remainderSamps -= n;
+    next_index = _rx_stream.remainder_index + _rx_stream.remainderOffset;
 
     if (_rx_stream.remainderSamps == 0) {
       this->releaseReadBuffer(stream, _rx_stream.remainderHandle);
       _rx_stream.remainderHandle = -1;
       _rx_stream.remainderOffset = 0;
+      if (_rx_stream.remainder_burst_end) {
+        flags |= SOAPY_SDR_END_BURST;
+        break;
+      }
     }
+  }
 
-    if (n == returnedElems) return returnedElems;
+  return samp_avail;
+}
+
+bool SoapyHackRFDuplex::sync_rx_path(void) {
+  std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+  // a raw remainder or undelivered DDC output finishes on its own path
+  if (_rx_stream.remainderHandle < 0 and
+      _rx_stream.dsp_offset >= _rx_stream.dsp_samps) {
+    _rx_stream.dsp_active = _rx_stream.dsp_wanted;
   }
+  return _rx_stream.dsp_active;
+}
 
-  size_t handle;
-  int ret = this->acquireReadBuffer(stream, handle,
-                                    (const void **)&_rx_stream.remainderBuff,
-                                    flags, timeNs, timeoutUs);
+void SoapyHackRFDuplex::configure_rx_dsp(void) {
+  const size_t mtu = _rx_stream.buf_len / BYTES_PER_SAMPLE;
 
-  if (ret < 0) {
-    if ((ret == SOAPY_SDR_TIMEOUT) && (samp_avail > 0)) {
-      return samp_avail;
-    }
-    return ret;
+  for (size_t i = 0; i < _rx_stream.channels.size(); ++i) {
+    RXChannel &ch = _rx_stream.channels[i];
+    ch.ddc.configure(ch.offset, _rx_stream.samplerate, ch.decim, ch.ratio);
   }
 
-  _rx_stream.remainderHandle = handle;
-  _rx_stream.remainderSamps = ret;
+  _rx_stream.dsp_out.resize(_rx_stream.stream_channels.size());
+  for (size_t i = 0; i < _rx_stream.stream_channels.size(); ++i) {
+    const RXChannel &ch = _rx_stream.channels[_rx_stream.stream_channels[i]];
+    _rx_stream.dsp_out[i].resize(ch.ddc.max_output(mtu) * 2);
+  }
+  _rx_stream.dsp_dirty = false;
+}
+
+int SoapyHackRFDuplex::read_stream_dsp(
+    void *const *buffs, const size_t numElems, int &flags, long long &timeNs,
+    const long timeoutUs, const bool fill,
+    const std::chrono::steady_clock::time_point &deadline) {
+  size_t samp_avail = 0;
 
-  const size_t n =
-      std::min((returnedElems - samp_avail), _rx_stream.remainderSamps);
+  while (samp_avail < numElems) {
+    if (_rx_stream.dsp_offset == _rx_stream.dsp_samps) {
+      const long wait =
+          samp_avail == 0 ? timeoutUs : (fill ? remaining_us(deadline) : 0);
+      int buf_flags = 0;
+      long long buf_time = 0;
+      int ret = this->refill_rx_dsp(buf_flags, buf_time, wait);
+      if (ret < 0) {
+        if (samp_avail == 0) {
+          flags |= buf_flags;
+          if (buf_flags & SOAPY_SDR_HAS_TIME) timeNs = buf_time;
+          return ret;
+        }
+        if (ret == SOAPY_SDR_OVERFLOW) {
+          std::lock_guard<std::mutex> lock(_rx_buf_mutex);
+          _rx_stream.overflow = true;
+        }
+        break;
+      }
+      // a squelch gap, the new samples start the next call
+      if (samp_avail > 0 and _rx_stream.dsp_gap) break;
+    }
 
-  readbuf(_rx_stream.remainderBuff, buffs[0], n, _rx_stream.format, samp_avail);
-  _rx_stream.remainderSamps -= n;
-  _rx_stream.remainderOffset += n;
+    if (samp_avail == 0) {
+      timeNs = _rx_stream.dsp_time;
+      if (_rx_stream.dsp_rate > 0) {
+        timeNs +=
+            (long long)(_rx_stream.dsp_offset * 1e9 / _rx_stream.dsp_rate);
+      }
+      flags |= SOAPY_SDR_HAS_TIME;
+    }
 
-  if (_rx_stream.remainderSamps == 0) {
-    this->releaseReadBuffer(stream, _rx_stream.remainderHandle);
+    size_t n = std::min(numElems - samp_avail,
+                        _rx_stream.dsp_samps - _rx_stream.dsp_offset);
+    if (_rx_stream.acq_limit) n = std::min(n, _rx_stream.acq_left);
+    for (size_t i = 0; i < _rx_stream.dsp_out.size(); ++i) {
+      readbuf(&_rx_stream.dsp_out[i][_rx_stream.dsp_offset * 2], buffs[i], n,
+              _rx_stream.format, samp_avail, _rx_stream.scale);
+    }
+    _rx_stream.dsp_offset += n;
+    samp_avail += n;
+
+    if (_rx_stream.acq_limit and (_rx_stream.acq_left -= n) == 0) {
+      // the acquisition is complete, the rest of its window is dropped
+      _rx_stream.acq_limit = false;
+      _rx_stream.acq_discard = not _rx_stream.dsp_burst_end;
+      _rx_stream.dsp_offset = _rx_stream.dsp_samps;
+      flags |= SOAPY_SDR_END_BURST;
+      break;
+    }
+
+    if (_rx_stream.dsp_offset == _rx_stream.dsp_samps and
+        _rx_stream.dsp_burst_end) {
+      flags |= SOAPY_SDR_END_BURST;
+      break;
+    }
+  }
+
+  return samp_avail;
+}
+
+int SoapyHackRFDuplex::refill_rx_dsp(int &flags, long long &timeNs,
+                                     const long timeoutUs) {
+  // refill the per channel outputs from one wideband buffer; the buffer is
+  // acquired before taking _rx_dsp_mutex to keep the lock order
+  // device -> dsp
+  int ret = 0;
+  uint64_t index = 0;
+  long long time = 0;
+  bool burst_end = false;
+  if (_rx_stream.remainderHandle >= 0) {
+    // left over from the plain CS8 path before the DSP was switched in
+    ret = _rx_stream.remainderSamps;
+    index = _rx_stream.remainder_index + _rx_stream.remainderOffset;
+    time = _rx_stream.remainder_time;
+    if (_rx_stream.samplerate > 0) {
+      time += (long long)(_rx_stream.remainderOffset * 1e9 /
+                          _rx_stream.samplerate);
+    }
+    burst_end = _rx_stream.remainder_burst_end;
+    HackRF_cs8_to_cf32(_rx_stream.remainderBuff +
+                           _rx_stream.remainderOffset * BYTES_PER_SAMPLE,
+                       _rx_stream.dsp_in.data(), ret);
+    this->releaseReadBuffer(RX_STREAM, _rx_stream.remainderHandle);
     _rx_stream.remainderHandle = -1;
     _rx_stream.remainderOffset = 0;
+    _rx_stream.remainderSamps = 0;
+  } else {
+    size_t handle;
+    const void *raw = nullptr;
+    while (_rx_stream.acq_discard) {
+      ret = this->acquireReadBuffer(RX_STREAM, handle, &raw, flags, time,
+                                    timeoutUs);
+      if (ret < 0) return ret;
+      _rx_stream.acq_discard = not(flags & SOAPY_SDR_END_BURST);
+      flags = 0;
+      this->releaseReadBuffer(RX_STREAM, handle);
+    }
+    ret = this->acquireReadBuffer(RX_STREAM, handle, &raw, flags, time,
+                                  timeoutUs);
+    if (ret < 0) {
+      timeNs = time;
+      return ret;
+    }
+
+    index = _rx_stream.buf_index[handle];
+    burst_end = (flags & SOAPY_SDR_END_BURST) != 0;
+    HackRF_cs8_to_cf32((const int8_t *)raw, _rx_stream.dsp_in.data(), ret);
+    this->releaseReadBuffer(RX_STREAM, handle);
+  }
+
+  std::lock_guard<std::mutex> lock(_rx_dsp_mutex);
+  if (_rx_stream.dsp_dirty) this->configure_rx_dsp();
+
+  // restart the filters rather than run them across a squelch gap
+  _rx_stream.dsp_gap = index != _rx_stream.dsp_index;
+  _rx_stream.dsp_index = index + ret;
+  _rx_stream.dsp_time = time;
+  _rx_stream.dsp_burst_end = burst_end;
+
+  const std::vector<size_t> &chans = _rx_stream.stream_channels;
+  for (size_t i = 0; i < chans.size(); ++i) {
+    if (_rx_stream.channels[chans[i]].decim !=
+            _rx_stream.channels[chans[0]].decim or
+        _rx_stream.channels[chans[i]].ratio !=
+            _rx_stream.channels[chans[0]].ratio) {
+      SoapySDR_logf(SOAPY_SDR_ERROR,
+                    "All channels of a stream must share a sample rate");
+      return SOAPY_SDR_NOT_SUPPORTED;
+    }
   }
 
-  return (returnedElems);
+  const RXChannel &first = _rx_stream.channels[chans[0]];
+  _rx_stream.dsp_rate = _rx_stream.samplerate / first.decim * first.ratio;
+
+  // single pass over the wideband data, every channel from the same input
+  for (size_t i = 0; i < chans.size(); ++i) {
+    if (_rx_stream.dsp_gap) _rx_stream.channels[chans[i]].ddc.reset();
+    _rx_stream.dsp_samps = _rx_stream.channels[chans[i]].ddc.process(
+        _rx_stream.dsp_in.data(), ret, _rx_stream.dsp_out[i].data());
+  }
+  _rx_stream.dsp_offset = 0;
+
+  return _rx_stream.dsp_samps;
 }
 
 int SoapyHackRFDuplex::writeStream(SoapySDR::Stream *stream,
@@ -646,73 +1704,241 @@ int SoapyHackRFDuplex::writeStream(SoapySDR::Stream *stream,
     return SOAPY_SDR_NOT_SUPPORTED;
   }
 
-  size_t returnedElems = std::min(numElems, this->getStreamMTU(stream));
+  if (_tx_stream.cyclic) {
+    return this->cyclic_write(buffs, numElems, flags);
+  }
 
-  size_t samp_avail = 0;
+  if (flags & HACKRF_TX_URGENT) {
+    this->flush_tx_queue(true);
+    flags &= ~HACKRF_TX_URGENT;
+  } else {
+    bool flushed;
+    {
+      std::lock_guard<std::mutex> lock(_tx_buf_mutex);
+      flushed = _tx_stream.flush_pending;
+      _tx_stream.flush_pending = false;
+    }
+    if (flushed) this->drop_tx_held();
+  }
 
-  if (_tx_stream.remainderHandle >= 0) {
-    const size_t n = std::min(_tx_stream.remainderSamps, returnedElems);
+  const bool fill = _tx_stream.fill or (flags & SOAPY_SDR_WAIT_TRIGGER);
+  const std::chrono::steady_clock::time_point deadline =
+      std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+
+  if (this->sync_tx_path()) {
+    return this->write_stream_dsp(buffs, numElems, flags, timeNs, timeoutUs,
+                                  deadline);
+  }
 
-    if (n < returnedElems) {
-      samp_avail = n;
+  size_t samp_avail = 0;
+
+  while (samp_avail < numElems) {
+    if (_tx_stream.remainderHandle < 0) {
+      const long wait =
+          samp_avail == 0 ? timeoutUs : (fill ? remaining_us(deadline) : 0);
+      size_t handle;
+      int ret = this->acquireWriteBuffer(
+          stream, handle, (void **)&_tx_stream.remainderBuff, wait);
+      if (ret < 0) {
+        if (samp_avail == 0) return ret;
+        break;
+      }
+      _tx_stream.remainderHandle = handle;
+      _tx_stream.remainderSamps = ret;
+      _tx_stream.remainderOffset = 0;
     }
 
+    const size_t n =
+        std::min(numElems - samp_avail, _tx_stream.remainderSamps);
+
     writebuf(buffs[0],
              _tx_stream.remainderBuff +
                  _tx_stream.remainderOffset * BYTES_PER_SAMPLE,
-             n, _tx_stream.format, 0);
+             n, _tx_stream.format, samp_avail, _tx_stream.scale);
+    samp_avail += n;
     _tx_stream.remainderSamps -= n;
     _tx_stream.remainderOffset += n;
 
-    if (_tx_stream.remainderSamps == 0) {
+    // only the buffer holding the last sample of the call ends a burst
+    const bool last = samp_avail == numElems;
+    int release_flags = last ? flags : (flags & ~SOAPY_SDR_END_BURST);
+    if (_tx_stream.remainderSamps == 0 or
+        (last and (flags & SOAPY_SDR_END_BURST) != 0)) {
       this->releaseWriteBuffer(stream, _tx_stream.remainderHandle,
-                               _tx_stream.remainderOffset, flags, timeNs);
+                               _tx_stream.remainderOffset, release_flags,
+                               timeNs);
       _tx_stream.remainderHandle = -1;
       _tx_stream.remainderOffset = 0;
+      _tx_stream.remainderSamps = 0;
     }
-
-    if (n == returnedElems) return returnedElems;
   }
 
-  size_t handle;
+  return samp_avail;
+}
 
-  int ret = this->acquireWriteBuffer(
-      stream, handle, (void **)&_tx_stream.remainderBuff, timeoutUs);
-  if (ret < 0) {
-    if ((ret == SOAPY_SDR_TIMEOUT) && (samp_avail > 0)) {
-      return samp_avail;
+void SoapyHackRFDuplex::flush_tx_queue(const bool writer) {
+  {
+    std::lock_guard<std::mutex> lock(_tx_buf_mutex);
+    const long long now = HackRF_timeNs();
+    for (uint32_t i = 0; i < _tx_stream.buf_count; ++i) {
+      const uint32_t slot = (_tx_stream.buf_tail + i) % _tx_stream.buf_num;
+      // bursts already acked in the tail slot are skipped
+      const size_t first = i == 0 ? _tx_stream.tail_burst : 0;
+      const std::vector<uint32_t> &ends = _tx_stream.buf_burst_ends[slot];
+      for (size_t b = first; b < ends.size(); ++b) {
+        // the burst will not be acked as sent, report it cut short instead
+        if (_tx_stream.events.size() == HACKRF_MAX_STREAM_EVENTS) {
+          _tx_stream.events.pop_front();
+        }
+        _tx_stream.events.push_back(StreamEvent(
+            0,
+            SOAPY_SDR_END_BURST | SOAPY_SDR_END_ABRUPT | SOAPY_SDR_HAS_TIME,
+            now));
+      }
     }
-    return ret;
+    _tx_stream.dropped += _tx_stream.queued;
+    _tx_stream.queued = 0;
+    _tx_stream.tail_offset = 0;
+    _tx_stream.tail_burst = 0;
+    _tx_stream.buf_tail =
+        (_tx_stream.buf_tail + _tx_stream.buf_count) % _tx_stream.buf_num;
+    _tx_stream.buf_count = 0;
+    _tx_stream.in_gap = true;
+    // the writer's part filled transfer and the DUC hold older samples
+    // too; only the writer may touch them, it drops them on its next write
+    _tx_stream.flush_pending = not writer;
+    _tx_buf_cond.notify_one();
   }
 
-  _tx_stream.remainderHandle = handle;
-  _tx_stream.remainderSamps = ret;
-
-  const size_t n =
-      std::min((returnedElems - samp_avail), _tx_stream.remainderSamps);
+  if (writer) this->drop_tx_held();
+  _tx_notify.signal();
+}
 
-  writebuf(buffs[0], _tx_stream.remainderBuff, n, _tx_stream.format,
-           samp_avail);
-  _tx_stream.remainderSamps -= n;
-  _tx_stream.remainderOffset += n;
+void SoapyHackRFDuplex::drop_tx_held(void) {
+  size_t pending;
+  {
+    std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+    pending = _tx_stream.duc.pending();
+    _tx_stream.duc.reset();
+  }
+  _tx_stream.dsp_burst_end = false;
 
-  if (_tx_stream.remainderSamps == 0) {
-    this->releaseWriteBuffer(stream, _tx_stream.remainderHandle,
-                             _tx_stream.remainderOffset, flags, timeNs);
-    _tx_stream.remainderHandle = -1;
+  std::lock_guard<std::mutex> lock(_tx_buf_mutex);
+  _tx_stream.dropped += pending;
+  if (_tx_stream.remainderHandle >= 0) {
+    _tx_stream.dropped += _tx_stream.remainderOffset;
+    _tx_stream.remainderSamps += _tx_stream.remainderOffset;
     _tx_stream.remainderOffset = 0;
   }
+}
 
-  return returnedElems;
+bool SoapyHackRFDuplex::sync_tx_path(void) {
+  std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+  // both paths fill the same CS8 remainder, only the DUC has to be empty
+  if (_tx_stream.duc.pending() == 0 and not _tx_stream.dsp_burst_end) {
+    _tx_stream.dsp_active = _tx_stream.dsp_wanted;
+  }
+  return _tx_stream.dsp_active;
+}
+
+int SoapyHackRFDuplex::flush_tx_dsp(const long timeoutUs) {
+  int flags = 0;
+
+  while (true) {
+    if (_tx_stream.remainderHandle < 0) {
+      {
+        std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+        if (_tx_stream.duc.pending() == 0 and not _tx_stream.dsp_burst_end) {
+          return 0;
+        }
+      }
+      size_t handle;
+      int ret = this->acquireWriteBuffer(
+          TX_STREAM, handle, (void **)&_tx_stream.remainderBuff, timeoutUs);
+      if (ret < 0) return ret;
+      _tx_stream.remainderHandle = handle;
+      _tx_stream.remainderSamps = ret;
+      _tx_stream.remainderOffset = 0;
+    }
+
+    size_t produced = 0;
+    {
+      std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+      produced = _tx_stream.duc.pull(
+          _tx_stream.remainderBuff +
+              _tx_stream.remainderOffset * BYTES_PER_SAMPLE,
+          _tx_stream.remainderSamps);
+    }
+    _tx_stream.remainderSamps -= produced;
+    _tx_stream.remainderOffset += produced;
+
+    if (_tx_stream.remainderSamps == 0) {
+      this->releaseWriteBuffer(TX_STREAM, _tx_stream.remainderHandle,
+                               _tx_stream.remainderOffset, flags);
+      _tx_stream.remainderHandle = -1;
+      _tx_stream.remainderOffset = 0;
+    } else if (produced == 0) {
+      if (_tx_stream.dsp_burst_end) {
+        // the burst is fully interpolated, send its last transfer now
+        flags = SOAPY_SDR_END_BURST;
+        this->releaseWriteBuffer(TX_STREAM, _tx_stream.remainderHandle,
+                                 _tx_stream.remainderOffset, flags);
+        _tx_stream.remainderHandle = -1;
+        _tx_stream.remainderOffset = 0;
+        _tx_stream.remainderSamps = 0;
+        _tx_stream.dsp_burst_end = false;
+        return 0;
+      }
+      // DUC drained, the partly filled transfer waits for the next write
+      return 0;
+    }
+  }
+}
+
+int SoapyHackRFDuplex::write_stream_dsp(
+    const void *const *buffs, const size_t numElems, int &flags,
+    const long long timeNs, const long timeoutUs,
+    const std::chrono::steady_clock::time_point &deadline) {
+  // anything still held from the last call goes out first, so a full ring
+  // is reported as a timeout before new samples are accepted
+  int ret = this->flush_tx_dsp(timeoutUs);
+  if (ret < 0) return ret;
+
+  // convert the user's samples once, the DUC then writes CS8 straight into
+  // the transfer buffers
+  _tx_stream.dsp_in.resize(numElems * BYTES_PER_SAMPLE);
+  writebuf(buffs[0], _tx_stream.dsp_in.data(), numElems, _tx_stream.format, 0,
+           _tx_stream.scale);
+
+  {
+    std::lock_guard<std::mutex> lock(_tx_dsp_mutex);
+    if (_tx_stream.dsp_dirty) {
+      _tx_stream.duc.configure(_tx_stream.offset, _tx_stream.samplerate,
+                               _tx_stream.interp, _tx_stream.ratio);
+      _tx_stream.dsp_dirty = false;
+    }
+    _tx_stream.duc.push(_tx_stream.dsp_in.data(), numElems);
+  }
+  if (flags & SOAPY_SDR_END_BURST) _tx_stream.dsp_burst_end = true;
+
+  // the samples are accepted now, a timeout here only leaves them queued.
+  // The whole call shares one timeout however many transfers it fills.
+  ret = this->flush_tx_dsp(remaining_us(deadline));
+  if (ret < 0 and ret != SOAPY_SDR_TIMEOUT) return ret;
+
+  return numElems;
 }
 
 int SoapyHackRFDuplex::readStreamStatus(SoapySDR::Stream *stream,
                                         size_t &chanMask, int &flags,
                                         long long &timeNs,
                                         const long timeoutUs) {
-  if (stream != TX_STREAM) {
+  if (stream != TX_STREAM and stream != RX_STREAM) {
     return SOAPY_SDR_NOT_SUPPORTED;
   }
+  std::mutex &buf_mutex = stream == RX_STREAM ? _rx_buf_mutex : _tx_buf_mutex;
+  std::deque<StreamEvent> &events =
+      stream == RX_STREAM ? _rx_stream.events : _tx_stream.events;
 
   // calculate when the loop should exit
   const auto timeout =
@@ -722,7 +1948,20 @@ int SoapyHackRFDuplex::readStreamStatus(SoapySDR::Stream *stream,
 
   // poll for status events until the timeout expires
   while (true) {
-    if (_tx_stream.underflow) {
+    {
+      // TX stream start and burst acks, RX overflow gaps, oldest first
+      std::lock_guard<std::mutex> lock(buf_mutex);
+      if (not events.empty()) {
+        const StreamEvent event = events.front();
+        events.pop_front();
+        chanMask = 1;
+        flags = event.flags;
+        timeNs = event.timeNs;
+        return event.ret;
+      }
+    }
+
+    if (stream == TX_STREAM and _tx_stream.underflow) {
       _tx_stream.underflow = false;
       SoapySDR::log(SOAPY_SDR_SSI, "U");
       return SOAPY_SDR_UNDERFLOW;
@@ -746,7 +1985,7 @@ int SoapyHackRFDuplex::acquireReadBuffer(SoapySDR::Stream *stream,
     return SOAPY_SDR_NOT_SUPPORTED;
   }
 
-  if (_rx_active != HACKRF_TRANSCEIVER_MODE_ON) {
+  if (_rx_active != HACKRF_TRANSCEIVER_MODE_ON or _rx_stream.paused) {
     // wait for tx to be consumed before switching
     //  {
     //  	std::unique_lock <std::mutex> lock( _rx_buf_mutex );
@@ -761,13 +2000,29 @@ int SoapyHackRFDuplex::acquireReadBuffer(SoapySDR::Stream *stream,
 
   std::unique_lock<std::mutex> lock(_rx_buf_mutex);
 
-  while (_rx_stream.buf_count == 0) {
+  // slots already acquired are still counted until they are released
+  while (_rx_stream.buf_count == _rx_stream.buf_held) {
     _rx_buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs));
-    if (_rx_stream.buf_count == 0) return SOAPY_SDR_TIMEOUT;
+    if (_rx_stream.buf_count == _rx_stream.buf_held) return SOAPY_SDR_TIMEOUT;
   }
 
+  // a gap is reported once everything queued before it has been read
+  std::deque<std::pair<uint64_t, long long> > &marks =
+      _rx_stream.overflow_marks;
+  const uint64_t next = _rx_stream.buf_index[_rx_stream.buf_head];
+  if (not _rx_stream.overflow and not marks.empty() and
+      next >= marks.front().first) {
+    _rx_stream.overflow = true;
+    _rx_stream.overflow_time = marks.front().second;
+    while (not marks.empty() and next >= marks.front().first) {
+      marks.pop_front();
+    }
+  }
   if (_rx_stream.overflow) {
-    flags |= SOAPY_SDR_END_ABRUPT;
+    // timed at the first lost sample, the next buffer's time marks the end
+    // of the gap
+    flags |= SOAPY_SDR_END_ABRUPT | SOAPY_SDR_HAS_TIME;
+    timeNs = _rx_stream.overflow_time;
     _rx_stream.overflow = false;
     SoapySDR::log(SOAPY_SDR_SSI, "O");
     return SOAPY_SDR_OVERFLOW;
@@ -775,9 +2030,17 @@ int SoapyHackRFDuplex::acquireReadBuffer(SoapySDR::Stream *stream,
 
   handle = _rx_stream.buf_head;
   _rx_stream.buf_head = (_rx_stream.buf_head + 1) % _rx_stream.buf_num;
+  _rx_stream.buf_held++;
   this->getDirectAccessBufferAddrs(stream, handle, (void **)buffs);
 
-  return this->getStreamMTU(stream);
+  // time of the first sample; END_BURST when the squelch closes after it
+  timeNs = _rx_stream.buf_time[handle];
+  flags |= SOAPY_SDR_HAS_TIME;
+  if (_rx_stream.buf_burst_end[handle]) flags |= SOAPY_SDR_END_BURST;
+
+  // direct access buffers hold raw wideband samples, a whole transfer
+  // unless the slot holds a detected window
+  return _rx_stream.buf_samps[handle];
 }
 
 void SoapyHackRFDuplex::releaseReadBuffer(SoapySDR::Stream *stream,
@@ -788,6 +2051,14 @@ void SoapyHackRFDuplex::releaseReadBuffer(SoapySDR::Stream *stream,
 
   std::unique_lock<std::mutex> lock(_rx_buf_mutex);
   _rx_stream.buf_count--;
+  if (_rx_stream.buf_held > 0) _rx_stream.buf_held--;
+  this->unspill_rx();
+
+  // an adaptive ring is resized while the reader holds no slots
+  const bool resize = _rx_stream.buf_target != _rx_stream.buf_num and
+                      _rx_stream.buf_held == 0;
+  lock.unlock();
+  if (resize) this->resize_rx_ring();
 }
 
 int SoapyHackRFDuplex::acquireWriteBuffer(SoapySDR::Stream *stream,
@@ -797,30 +2068,49 @@ int SoapyHackRFDuplex::acquireWriteBuffer(SoapySDR::Stream *stream,
     return SOAPY_SDR_NOT_SUPPORTED;
   }
 
-  if (_tx_active != HACKRF_TRANSCEIVER_MODE_ON) {
+  // a pending start is up to releaseWriteBuffer
+  if ((_tx_active != HACKRF_TRANSCEIVER_MODE_ON or _tx_stream.paused) and
+      not _tx_stream.start_pending) {
     int ret = this->activateStream(stream);
     if (ret < 0) return ret;
   }
 
+  // the latency budget in board samples, 0 for none. It is never less than
+  // a transfer, the callback could not fill one from the ring otherwise.
+  const size_t full = _tx_stream.buf_len / BYTES_PER_SAMPLE;
+  const uint64_t budget =
+      _tx_stream.latency_us > 0
+          ? std::max<uint64_t>(
+                _tx_stream.latency_us * _tx_stream.samplerate / 1e6, full)
+          : 0;
+  // wait for a useful amount of room rather than grant a few samples
+  const uint64_t min_grant =
+      std::min<uint64_t>(full, std::max<uint64_t>(budget / 4, 1));
+
   std::unique_lock<std::mutex> lock(_tx_buf_mutex);
 
-  while (_tx_stream.buf_count == _tx_stream.buf_num) {
+  const auto room = [this, full, budget]() -> uint64_t {
+    if (_tx_stream.buf_count == _tx_stream.buf_num) return 0;
+    if (budget == 0) return full;
+    const uint64_t used = _tx_stream.queued + _tx_stream.granted;
+    return used < budget ? std::min<uint64_t>(full, budget - used) : 0;
+  };
+  uint64_t grant = room();
+  while (grant < min_grant) {
     _tx_buf_cond.wait_for(lock, std::chrono::microseconds(timeoutUs));
-    if (_tx_stream.buf_count == _tx_stream.buf_num) return SOAPY_SDR_TIMEOUT;
+    grant = room();
+    if (grant < min_grant) return SOAPY_SDR_TIMEOUT;
   }
 
   handle = _tx_stream.buf_head;
   _tx_stream.buf_head = (_tx_stream.buf_head + 1) % _tx_stream.buf_num;
+  _tx_stream.buf_samps[handle] = grant;
+  _tx_stream.granted += grant;
 
   this->getDirectAccessBufferAddrs(stream, handle, buffs);
 
-  if (_tx_stream.burst_end) {
-    if ((_tx_stream.burst_samps - int32_t(this->getStreamMTU(stream))) < 0) {
-      memset(buffs[0], 0, this->getStreamMTU(stream));
-      return _tx_stream.burst_samps;
-    }
-  }
-  return this->getStreamMTU(stream);
+  // transfer sized, or what is left of the latency budget
+  return grant;
 }
 
 void SoapyHackRFDuplex::releaseWriteBuffer(SoapySDR::Stream *stream,
@@ -828,8 +2118,56 @@ void SoapyHackRFDuplex::releaseWriteBuffer(SoapySDR::Stream *stream,
                                            const size_t numElems, int &flags,
                                            const long long timeNs) {
   if (stream == TX_STREAM) {
-    std::unique_lock<std::mutex> lock(_tx_buf_mutex);
-    _tx_stream.buf_count++;
+    // a short buffer runs straight on into the next one, the callback only
+    // pads with zeros once the ring is empty
+    bool start = false;
+    {
+      std::unique_lock<std::mutex> lock(_tx_buf_mutex);
+      const uint32_t n =
+          std::min<uint32_t>(numElems, _tx_stream.buf_samps[handle]);
+      const bool burst_end = (flags & SOAPY_SDR_END_BURST) != 0;
+      _tx_stream.granted -= _tx_stream.buf_samps[handle];
+      _tx_stream.queued += n;
+
+      // pack a short write behind the last queued slot while it has room,
+      // so short bursts do not take a ring slot each. Only the newest grant
+      // can be folded back, its slot is then free again.
+      const uint32_t num = _tx_stream.buf_num;
+      const uint32_t prev = (handle + num - 1) % num;
+      if (_tx_stream.buf_count > 0 and
+          (_tx_stream.buf_tail + _tx_stream.buf_count) % num == handle and
+          (handle + 1) % num == _tx_stream.buf_head and
+          _tx_stream.buf_samps[prev] + n <=
+              _tx_stream.buf_len / BYTES_PER_SAMPLE) {
+        memcpy(_tx_stream.buf[prev] +
+                   _tx_stream.buf_samps[prev] * BYTES_PER_SAMPLE,
+               _tx_stream.buf[handle], n * BYTES_PER_SAMPLE);
+        _tx_stream.buf_samps[prev] += n;
+        if (burst_end) {
+          _tx_stream.buf_burst_ends[prev].push_back(
+              _tx_stream.buf_samps[prev]);
+        }
+        _tx_stream.buf_head = handle;
+      } else {
+        _tx_stream.buf_samps[handle] = n;
+        _tx_stream.buf_burst_ends[handle].clear();
+        if (burst_end) _tx_stream.buf_burst_ends[handle].push_back(n);
+        _tx_stream.buf_count++;
+      }
+      // a burst shorter than the preroll starts the board as it ends, and
+      // a latency budget may be smaller than the preroll
+      start = _tx_stream.start_pending and
+              (_tx_stream.buf_count >= _tx_stream.preroll or burst_end or
+               (_tx_stream.latency_us > 0 and _tx_stream.granted == 0 and
+                _tx_stream.queued * BYTES_PER_SAMPLE >= _tx_stream.buf_len and
+                _tx_stream.queued * 1e6 >=
+                    _tx_stream.latency_us * _tx_stream.samplerate));
+    }
+    if (start) {
+      // not through activateStream(), which holds back for the preroll
+      std::lock_guard<std::mutex> lock(_tx_device_mutex);
+      if (_tx_stream.start_pending) this->start_tx();
+    }
   } else {
     throw std::runtime_error("Invalid stream");
   }
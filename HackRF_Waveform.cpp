@@ -0,0 +1,111 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Logger.hpp>
+#include <algorithm>
+
+#include "SoapyHackRFDuplex.hpp"
+
+/*
+ * Cyclic TX: with the "cyclic" stream arg, writeStream converts samples to
+ * CS8 once and appends them to the waveform being uploaded; END_BURST
+ * stores it under the id set with "tx_waveform_upload". The TX callback
+ * then loops the selected waveform with no application thread involved.
+ * Selecting another waveform takes effect when the current one wraps, so
+ * the switch is sample exact and never cuts a waveform short.
+ */
+
+int SoapyHackRFDuplex::cyclic_write(const void *const *buffs,
+                                    const size_t numElems, const int flags) {
+  {
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+    if (_waveforms.upload_restart) {
+      _waveforms.upload.clear();
+      _waveforms.upload_restart = false;
+    }
+  }
+
+  // the upload buffer belongs to the writer, so the conversion runs
+  // without holding up the TX callback
+  const size_t used = _waveforms.upload.size();
+  _waveforms.upload.resize(used + numElems * BYTES_PER_SAMPLE);
+  writebuf(buffs[0], _waveforms.upload.data() + used, numElems,
+           _tx_stream.format, 0, _tx_stream.scale);
+
+  if ((flags & SOAPY_SDR_END_BURST) == 0 or _waveforms.upload.empty()) {
+    return numElems;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_waveform_mutex);
+
+    const int id = _waveforms.upload_id;
+    _waveforms.waveforms[id].swap(_waveforms.upload);
+    _waveforms.upload.clear();
+
+    if (_waveforms.current == id) {
+      // replaced while playing, start the new one from its beginning
+      _waveforms.pos = 0;
+    } else if (_waveforms.current < 0) {
+      _waveforms.current = id;
+      _waveforms.next = id;
+      _waveforms.pos = 0;
+    }
+
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "Stored TX waveform %d, %zu samples", id,
+                  _waveforms.waveforms[id].size() / BYTES_PER_SAMPLE);
+  }
+
+  // the first stored waveform starts the transmitter, as a first buffer
+  // would in the ring buffer path
+  if (_tx_active != HACKRF_TRANSCEIVER_MODE_ON) {
+    int ret = this->activateStream(TX_STREAM);
+    if (ret < 0) return ret;
+  }
+
+  return numElems;
+}
+
+void SoapyHackRFDuplex::cyclic_fill(int8_t *buffer, int32_t length) {
+  std::lock_guard<std::mutex> lock(_waveform_mutex);
+  size_t done = 0;
+
+  while (done < (size_t)length) {
+    std::map<int, std::vector<int8_t> >::const_iterator it =
+        _waveforms.waveforms.find(_waveforms.current);
+    if (it == _waveforms.waveforms.end() or it->second.empty()) {
+      memset(buffer + done, 0, length - done);
+      return;
+    }
+
+    const std::vector<int8_t> &wave = it->second;
+    const size_t n = std::min(length - done, wave.size() - _waveforms.pos);
+    memcpy(buffer + done, wave.data() + _waveforms.pos, n);
+    done += n;
+    _waveforms.pos += n;
+
+    if (_waveforms.pos == wave.size()) {
+      _waveforms.pos = 0;
+      _waveforms.current = _waveforms.next;
+    }
+  }
+}
@@ -28,9 +28,19 @@
 
 #include <SoapySDR/Device.hpp>
 #include <SoapySDR/Logger.hpp>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
 #include <mutex>
 #include <set>
+#include <thread>
+
+#include "HackRF_DSP.hpp"
+#include "HackRF_Seqlock.hpp"
+#include "SoapyHackRFDuplexCallbacks.hpp"
 
 #define BUF_LEN 262144
 #define BUF_NUM 15
@@ -39,20 +49,97 @@
 #define HACKRF_TX_VGA_MAX_DB 47
 #define HACKRF_RX_LNA_MAX_DB 40
 #define HACKRF_AMP_MAX_DB 14
+#define HACKRF_MAX_RX_CHANNELS 16
+#define HACKRF_MIN_SAMPLE_RATE 2000000
+#define HACKRF_MAX_SAMPLE_RATE 20000000
+#define HACKRF_BUF_ALIGN 4096
+#define HACKRF_RECORD_BUF_NUM 64
+#define HACKRF_PLAYBACK_READAHEAD (4 * BUF_LEN)
+#define HACKRF_MAX_STREAM_EVENTS 1024
+#define HACKRF_WORKER_TIMEOUT_US 100000
+#define HACKRF_SPECTRUM_MIN_SIZE 64
+#define HACKRF_SPECTRUM_MAX_SIZE 65536
+#define HACKRF_PREAMBLE_BUF_NUM 16
+#define HACKRF_RING_WINDOW 64
+#define HACKRF_RING_RESIZES 16
+#define HACKRF_RX_GAPS 64
+
+/// writeStream() flag: drop queued TX data not yet sent and queue this first
+#define HACKRF_TX_URGENT SOAPY_SDR_USER_FLAG0
+
+#ifndef SOAPY_SDR_CF16
+#define SOAPY_SDR_CF16 "CF16"
+#endif
 
 enum HackRF_Format {
   HACKRF_FORMAT_FLOAT32 = 0,
   HACKRF_FORMAT_INT16 = 1,
   HACKRF_FORMAT_INT8 = 2,
   HACKRF_FORMAT_FLOAT64 = 3,
+  HACKRF_FORMAT_FLOAT16 = 4,
+};
+
+/// What a full RX ring gives up, see the "overflow" stream arg
+enum HackRF_Overflow {
+  HACKRF_OVERFLOW_DROP_OLDEST = 0,
+  HACKRF_OVERFLOW_DROP_NEWEST = 1,
+  HACKRF_OVERFLOW_SPILL = 2,
 };
 
+/// Convert len samples between CS8 and a host format, see HackRF_Streaming.cpp
+void readbuf(int8_t *src, void *dst, uint32_t len, uint32_t format,
+             size_t offset, float scale);
+void readbuf(const float *src, void *dst, uint32_t len, uint32_t format,
+             size_t offset, float scale);
+void writebuf(const void *src, int8_t *dst, uint32_t len, uint32_t format,
+              size_t offset, float scale);
+void writebuf(const void *src, float *dst, uint32_t len, uint32_t format,
+              size_t offset, float scale);
+
 typedef enum {
   HACKRF_TRANSCEIVER_MODE_OFF = 0,
   HACKRF_TRANSCEIVER_MODE_ON = 1,
 } HackRF_transceiver_active_t;
 
-std::set<std::string> &HackRF_getClaimedSerials(void);
+/*!
+ * Process-wide registry of the boards held by SoapyHackRFDuplex instances,
+ * and placement of the libhackrf transfer threads, see HackRF_Boards.cpp.
+ * Serials are compared without leading zeros.
+ */
+class HackRF_BoardManager {
+ public:
+  static HackRF_BoardManager &instance(void);
+
+  /// Claim a board for an instance, false if another one holds it
+  bool claim(const std::string &serial);
+
+  void release(const std::string &serial);
+
+  bool claimed(const std::string &serial) const;
+
+  std::set<std::string> claimed_serials(void) const;
+
+  /// CPUs the transfer threads of every board are spread over in turn,
+  /// empty to let them run anywhere
+  void set_callback_cpus(const std::vector<int> &cpus);
+
+  std::vector<int> callback_cpus(void) const;
+
+  /// Called at the top of each transfer callback, cheap once placed
+  void place_callback_thread(void);
+
+ private:
+  HackRF_BoardManager(void);
+
+  mutable std::mutex _mutex;
+  std::set<std::string> _claimed;
+  std::vector<int> _cpus;
+  size_t _next_cpu;
+  std::atomic<unsigned> _generation;
+};
+
+/// Host clock in nanoseconds, used for all stream timestamps
+long long HackRF_timeNs(void);
 
 /*!
  * The session object manages hackrf_init/exit
@@ -145,6 +232,16 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
   int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle,
                                  void **buffs);
 
+  /*******************************************************************
+   * Sensor API
+   ******************************************************************/
+
+  std::vector<std::string> listSensors(void) const;
+
+  SoapySDR::ArgInfo getSensorInfo(const std::string &key) const;
+
+  std::string readSensor(const std::string &key) const;
+
   /*******************************************************************
    * Settings API
    ******************************************************************/
@@ -200,6 +297,10 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
    * Frequency API
    ******************************************************************/
 
+  void setFrequency(const int direction, const size_t channel,
+                    const double frequency,
+                    const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
+
   void setFrequency(const int direction, const size_t channel,
                     const std::string &name, const double frequency,
                     const SoapySDR::Kwargs &args = SoapySDR::Kwargs());
@@ -244,6 +345,151 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
   int hackrf_rx_callback(int8_t *buffer, int32_t length);
 
  private:
+  int read_stream_dsp(void *const *buffs, const size_t numElems, int &flags,
+                      long long &timeNs, const long timeoutUs, const bool fill,
+                      const std::chrono::steady_clock::time_point &deadline);
+
+  int refill_rx_dsp(int &flags, long long &timeNs, const long timeoutUs);
+
+  /// Start the TX board regardless of the preroll, with _tx_device_mutex held
+  int start_tx(void);
+
+  /// Drop the queued TX data; writer is true on the writer's own thread
+  void flush_tx_queue(const bool writer);
+
+  void drop_tx_held(void);
+
+  void configure_rx_dsp(void);
+
+  int arm_rx_acquisition(const int flags, const long long timeNs,
+                         const size_t numElems);
+
+  uint32_t trim_rx_history(uint32_t first, uint32_t pending, uint64_t start);
+
+  void track_rx_depth(const bool overflowed);
+
+  void resize_rx_ring(void);
+
+  void note_rx_loss(uint64_t index, uint64_t samps, long long time);
+
+  void close_rx_gap(void);
+
+  bool spill_rx(const int8_t *src, uint32_t samps, uint64_t index,
+                long long time, bool burst_end);
+
+  void spill_rx_history(void);
+
+  void unspill_rx(void);
+
+  void drop_rx_spill(void);
+
+  /// Publish the board settings, the caller holds the device mutex
+  void publish_device_config(const int direction);
+
+  /// Publish the channel settings, the caller holds the dsp mutex
+  void publish_dsp_config(const int direction);
+
+  void plan_rx_channels(void);
+
+  void plan_tx_dsp(void);
+
+  /// Move the reader or writer to the planned path if it is between
+  /// buffers, returns whether the DSP path is in use
+  bool sync_rx_path(void);
+
+  bool sync_tx_path(void);
+
+  int flush_tx_dsp(const long timeoutUs);
+
+  int write_stream_dsp(const void *const *buffs, const size_t numElems,
+                       int &flags, const long long timeNs,
+                       const long timeoutUs,
+                       const std::chrono::steady_clock::time_point &deadline);
+
+  void set_rx_board_rate(const double rate);
+
+  int start_relay(void);
+
+  void stop_relay(void);
+
+  /// Caller holds _relay_mutex
+  void configure_relay(void);
+
+  void relay_forward(const int8_t *buffer, int32_t length);
+
+  int start_recording(const std::string &path);
+
+  void stop_recording(void);
+
+  void record_push(const int8_t *buffer, int32_t length);
+
+  void record_writer(void);
+
+  void write_record_meta(void);
+
+  int start_playback(const std::string &path);
+
+  void stop_playback(void);
+
+  void playback_fill(int8_t *buffer, int32_t length);
+
+  int cyclic_write(const void *const *buffs, const size_t numElems,
+                   const int flags);
+
+  void cyclic_fill(int8_t *buffer, int32_t length);
+
+  int start_spectrum(void);
+
+  void stop_spectrum(void);
+
+  void spectrum_push(const int8_t *buffer, int32_t length);
+
+  void spectrum_worker(void);
+
+  int start_preamble(void);
+
+  void stop_preamble(void);
+
+  void preamble_push(const int8_t *buffer, uint32_t length, uint64_t index);
+
+  void preamble_worker(void);
+
+  void preamble_process(const int8_t *buffer, size_t n, uint64_t index,
+                        float threshold, size_t pre, size_t post);
+
+  /// Queue samps samples starting at sample index as one RX ring slot
+  void commit_rx_window(const int8_t *buffer, size_t samps, uint64_t index);
+
+  /*!
+   * Hand apply to the board's control worker under key, replacing a write
+   * to the same key still queued. False when async control is off or the
+   * caller is that worker, and the caller applies the write itself.
+   */
+  bool defer_control(const int direction, const std::string &key,
+                     const std::function<void(void)> &apply);
+
+  void start_control(void);
+
+  void stop_control(void);
+
+  void control_worker(const int direction);
+
+  /// Block until every control write up to seq has been applied
+  void wait_control(const uint64_t seq);
+
+  uint64_t control_completed(void) const;
+
+  int set_stream_callback(const int direction, const std::string &value);
+
+  /// Caller holds the device mutex of the stream
+  void start_stream_worker(SoapySDR::Stream *stream);
+
+  void stop_stream_worker(SoapySDR::Stream *stream);
+
+  void rx_worker_loop(const unsigned generation);
+
+  void tx_worker_loop(const unsigned generation);
+
   SoapySDR::Stream *const TX_STREAM = (SoapySDR::Stream *)0x1;
   SoapySDR::Stream *const RX_STREAM = (SoapySDR::Stream *)0x2;
 
@@ -260,7 +506,11 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
           remainderSamps(0),
           remainderOffset(0),
           remainderBuff(nullptr),
-          format(HACKRF_FORMAT_INT8) {}
+          format(HACKRF_FORMAT_INT8),
+          scale(127.0f),
+          fill(false),
+          standby(false),
+          paused(false) {}
 
     bool opened;
     uint32_t buf_num;
@@ -275,12 +525,67 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
     size_t remainderOffset;
     int8_t *remainderBuff;
     uint32_t format;
+    float scale;
+    bool fill;
+
+    // hot standby: deactivateStream() only pauses, the board streams on
+    bool standby;
+    std::atomic<bool> paused;
 
     ~Stream() { clear_buffers(); }
     void clear_buffers();
     void allocate_buffers();
   };
 
+  /// Status reported through readStreamStatus
+  struct StreamEvent {
+    StreamEvent(int ret = 0, int flags = 0, long long timeNs = 0)
+        : ret(ret), flags(flags), timeNs(timeNs) {}
+
+    int ret;
+    int flags;
+    long long timeNs;
+  };
+
+  /*!
+   * What the configuration getters report for one direction, published by
+   * the setters through a HackRF_Seqlock so the getters never wait on a
+   * device mutex held across USB control transfers or a stream restart.
+   */
+  struct ConfigSnapshot {
+    double frequency;
+    double samplerate;
+    double bandwidth;
+    double lna_gain;
+    double vga_gain;
+    double amp_gain;
+    // per channel NCO offset and application rate, 0 following the board
+    double offset[HACKRF_MAX_RX_CHANNELS];
+    double user_rate[HACKRF_MAX_RX_CHANNELS];
+  };
+
+  /// A transfer parked in the RX spill arena
+  struct RXSpill {
+    int8_t *buf;
+    uint32_t samps;
+    uint64_t index;
+    long long time;
+    uint8_t burst_end;
+  };
+
+  /// A virtual RX channel served by the channelizer
+  struct RXChannel {
+    RXChannel() : offset(0.0), user_rate(0.0), decim(1), ratio(1.0) {}
+
+    double offset;
+    double user_rate;  // 0 follows the board rate
+
+    // derived from user_rate and the board rate by plan_rx_channels()
+    size_t decim;
+    double ratio;
+    HackRF_DDC ddc;
+  };
+
   struct RXStream : Stream {
     uint32_t vga_gain;
     uint32_t lna_gain;
@@ -290,6 +595,118 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
     uint64_t frequency;
 
     bool overflow;
+
+    /*!
+     * Overflow policy and loss accounting, guarded by _rx_buf_mutex. Each
+     * run of lost samples is a gap. overflow_marks holds the index and time
+     * of gaps the reader has not reached; the acquire that would cross one
+     * returns SOAPY_SDR_OVERFLOW timed at its first lost sample instead,
+     * overflow_time. Once a gap closes it is queued for readStreamStatus()
+     * and kept in gaps as "index+count".
+     */
+    HackRF_Overflow overflow_policy;
+    std::deque<std::pair<uint64_t, long long> > overflow_marks;
+    long long overflow_time;
+    uint64_t gap_index;
+    uint64_t gap_samps;
+    long long gap_time;
+    uint64_t samples_lost;
+    std::deque<std::string> gaps;
+    std::deque<StreamEvent> events;
+
+    // spill arena, transfers that found the ring full in arrival order and
+    // the unused arena buffers; all are buf_len long like the ring slots
+    std::deque<RXSpill> spill;
+    std::vector<int8_t *> spill_free;
+
+    ~RXStream() { clear_spill(); }
+    void allocate_spill(uint32_t count);
+    void clear_spill();
+
+    // per ring slot metadata, guarded by _rx_buf_mutex. Slots from buf_head
+    // are committed, buf_held of them before buf_head are acquired and not
+    // yet released.
+    uint32_t buf_held;
+    std::vector<uint32_t> buf_samps;
+    std::vector<uint64_t> buf_index;
+    std::vector<long long> buf_time;
+    std::vector<uint8_t> buf_burst_end;
+    uint64_t sample_index;
+    long long start_time_ns;
+
+    // the buffer readStream is part way through
+    uint64_t remainder_index;
+    long long remainder_time;
+    bool remainder_burst_end;
+
+    // uncommitted transfers waiting after the committed ones as history
+    uint32_t history_pending;
+
+    /*!
+     * Adaptive depth, on when buf_max is above buf_min. The callback sets
+     * buf_target from the peak occupancy and overflows of each window of
+     * HACKRF_RING_WINDOW committed transfers, the reader resizes the ring
+     * to it once it holds no slots. Guarded by _rx_buf_mutex.
+     */
+    uint32_t buf_min;
+    uint32_t buf_max;
+    uint32_t buf_target;
+    std::string target_reason;
+    uint32_t window_count;
+    uint32_t window_peak;
+    std::deque<std::string> resizes;
+
+    /*!
+     * Squelch: only transfers at or above the threshold, squelch_pre before
+     * and squelch_post after them are committed, squelch_pre transfers are
+     * kept as history.
+     */
+    std::atomic<bool> squelch;
+    double squelch_threshold_db;
+    float squelch_threshold;
+    uint32_t squelch_pre;
+    uint32_t squelch_post;
+    uint32_t squelch_hold;
+    bool squelch_open;
+
+    /*!
+     * Finite acquisition: while acq is set only the sample indices
+     * [acq_start, acq_end) are committed, the last slot ending the burst,
+     * and enough transfers to cover acq_pre samples are kept as history.
+     * acq is written under both the device mutex and _rx_buf_mutex.
+     */
+    bool acq;
+    uint64_t acq_pre;
+    uint64_t acq_start;
+    uint64_t acq_end;
+    // channelized reads count the acquisition in output samples, and skip
+    // the rest of its window once acq_left runs out; owned by the reader
+    bool acq_limit;
+    size_t acq_left;
+    bool acq_discard;
+
+    /*
+     * channelizer state, all guarded by _rx_dsp_mutex. dsp_wanted is what
+     * the planner asks for, dsp_active the path the reader is on; the
+     * reader only follows dsp_wanted between buffers.
+     */
+    std::vector<RXChannel> channels;
+    std::vector<size_t> stream_channels;
+    bool dsp_dirty;
+    bool dsp_active;
+    bool dsp_wanted;
+
+    // converted input and per stream channel output, owned by the reader
+    std::vector<float> dsp_in;
+    std::vector<std::vector<float> > dsp_out;
+    size_t dsp_samps;
+    size_t dsp_offset;
+    // timing of dsp_out, and the wideband sample index expected next
+    long long dsp_time;
+    double dsp_rate;
+    uint64_t dsp_index;
+    bool dsp_burst_end;
+    bool dsp_gap;
   };
 
   struct TXStream : Stream {
@@ -302,12 +719,381 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
 
     bool underflow;
 
-    bool burst_end;
-    int32_t burst_samps;
+    /*
+     * Per ring slot sample counts and the sample offsets where bursts end
+     * in it; short writes are packed behind the last queued slot, so one
+     * slot can hold many bursts. The callback is tail_offset samples and
+     * tail_burst burst ends into the slot at buf_tail. Guarded by
+     * _tx_buf_mutex.
+     */
+    std::vector<std::vector<uint32_t> > buf_burst_ends;
+    std::vector<uint32_t> buf_samps;
+    uint32_t tail_offset;
+    uint32_t tail_burst;
+    bool in_gap;
+
+    /*!
+     * Latency budget: with latency_us set, acquireWriteBuffer() only grants
+     * space while the samples queued and granted stay within latency_us at
+     * the board rate. queued counts released samples the callback has not
+     * sent, granted the space handed out and not yet released.
+     */
+    long latency_us;
+    uint64_t queued;
+    uint64_t granted;
+    uint64_t dropped;
+    std::deque<StreamEvent> events;
+    // a flush from another thread leaves the writer to drop what it holds
+    bool flush_pending;
+
+    // interpolating DUC, configuration guarded by _tx_dsp_mutex; the
+    // writer follows dsp_wanted once the DUC has drained
+    double user_rate;
+    size_t interp;
+    double ratio;
+    double offset;
+    bool dsp_dirty;
+    bool dsp_active;
+    bool dsp_wanted;
+    HackRF_DUC duc;
+    std::vector<float> dsp_in;
+    bool dsp_burst_end;
+
+    /// writeStream uploads to the waveform store instead of the ring
+    bool cyclic;
+
+    // transfers queued before the board starts, 0 starts at once
+    uint32_t preroll;
+    std::atomic<bool> start_pending;
+    long long start_time_ns;
+  };
+
+  /// In-driver RX -> TX forwarding, see HackRF_Relay.cpp
+  struct Relay {
+    Relay()
+        : active(false),
+          owns_rx(false),
+          owns_tx(false),
+          gain_db(0.0),
+          offset(0.0),
+          latency_us(0),
+          max_buffers(0),
+          gain(1.0f),
+          forwarded(0),
+          dropped(0) {}
+
+    std::atomic<bool> active;
+    bool owns_rx;
+    bool owns_tx;
+
+    double gain_db;
+    double offset;
+    long latency_us;
+
+    // callback side state, guarded by _relay_mutex
+    uint32_t max_buffers;
+    float gain;
+    HackRF_NCO nco;
+    std::vector<float> work;
+    uint64_t forwarded;
+    uint64_t dropped;
+  };
+
+  /// Direct-to-disk RX capture, see HackRF_Record.cpp
+  struct Recorder {
+    Recorder()
+        : active(false),
+          owns_rx(false),
+          buf_num(HACKRF_RECORD_BUF_NUM),
+          fd(-1),
+          direct(false),
+          buf(nullptr),
+          head(0),
+          count(0),
+          received(0),
+          written(0),
+          next_index(0),
+          dropped(0),
+          stop(false),
+          samplerate(0),
+          frequency(0),
+          lna_gain(0),
+          vga_gain(0),
+          amp_gain(0) {}
+
+    std::atomic<bool> active;
+    bool owns_rx;
+    uint32_t buf_num;
+
+    std::string path;
+    int fd;
+    bool direct;
+
+    // pool of aligned transfer copies and the sample index of each since
+    // the start, guarded by _record_mutex
+    int8_t **buf;
+    std::vector<uint32_t> lengths;
+    std::vector<uint64_t> indices;
+    uint32_t head;
+    uint32_t count;
+
+    /*
+     * written counts the samples in the file and next_index the sample
+     * that would follow them. A slot that does not start at next_index,
+     * after a full pool or a failed write, opens a new capture segment.
+     */
+    uint64_t received;
+    uint64_t written;
+    uint64_t next_index;
+    uint64_t dropped;
+    /// (sample index in the file, sample index since the start) per gap
+    std::vector<std::pair<uint64_t, uint64_t> > gaps;
+
+    bool stop;
+    std::thread writer;
+    std::condition_variable cond;
+
+    // metadata captured when recording starts
+    std::string datetime;
+    double samplerate;
+    uint64_t frequency;
+    uint32_t lna_gain;
+    uint32_t vga_gain;
+    uint8_t amp_gain;
+  };
+
+  /// TX straight from a memory mapped capture, see HackRF_Playback.cpp
+  struct Playback {
+    Playback()
+        : active(false),
+          owns_tx(false),
+          loop(false),
+          rate_check(true),
+          offset(0),
+          map(nullptr),
+          map_size(0),
+          data_size(0),
+          pos(0),
+          advised(0),
+          finished(false) {}
+
+    std::atomic<bool> active;
+    bool owns_tx;
+
+    // options, applied when playback starts
+    bool loop;
+    bool rate_check;
+    uint64_t offset;
+
+    // mapping and position, guarded by _playback_mutex
+    std::string path;
+    const int8_t *map;
+    size_t map_size;
+    size_t data_size;
+    size_t pos;
+    size_t advised;
+    bool finished;
+  };
+
+  /// CS8 waveforms looped by the TX callback, see HackRF_Waveform.cpp
+  struct WaveformStore {
+    WaveformStore()
+        : upload_id(0), upload_restart(false), current(-1), next(-1), pos(0) {}
+
+    std::map<int, std::vector<int8_t> > waveforms;
+    // upload belongs to the writer; a new upload_id sets upload_restart and
+    // the writer drops its partial upload when it sees it
+    std::vector<int8_t> upload;
+    int upload_id;
+    bool upload_restart;
+    int current;
+    int next;
+    size_t pos;
+  };
+
+  /*!
+   * Readiness descriptor for event loop driven applications, see
+   * HackRF_Notify.cpp. Opened on first use; until then signal() is a no-op.
+   */
+  struct StreamNotifier {
+    StreamNotifier() : read_fd(-1), write_fd(-1) {}
+    ~StreamNotifier() { close(); }
+
+    std::atomic<int> read_fd;
+    std::atomic<int> write_fd;
+    std::mutex mutex;
+
+    /// Returns the descriptor to poll, or -1 if none could be created
+    int open(void);
+    void signal(void);
+    void close(void);
+  };
+
+  /// Driver-owned thread running a push model stream, see HackRF_Callback.cpp
+  struct StreamWorker {
+    StreamWorker()
+        : rx_fn(nullptr),
+          tx_fn(nullptr),
+          user(nullptr),
+          generation(0),
+          thread_generation(0) {}
+
+    SoapyHackRFDuplexRXCallback rx_fn;
+    SoapyHackRFDuplexTXCallback tx_fn;
+    void *user;
+
+    // a thread runs while generation still matches the value it started
+    // with, so a stopped thread never picks up a newer start
+    std::atomic<unsigned> generation;
+    unsigned thread_generation;
+    std::thread thread;
+
+    // converted samples, one buffer per stream channel, owned by the thread
+    std::vector<std::vector<uint8_t> > bufs;
+    std::vector<void *> buffs;
+  };
+
+  /// One board's queue of control writes, see HackRF_Control.cpp
+  struct ControlQueue {
+    ControlQueue() : enabled(false), quit(false), running(0) {}
+
+    struct Write {
+      std::string key;
+      std::function<void(void)> apply;
+      // the oldest write it replaced, so waiting on that one still waits
+      uint64_t first_seq;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool enabled;
+    bool quit;
+    std::deque<Write> writes;
+    uint64_t running;  // first_seq of the write being applied, 0 for none
+    std::thread thread;
+  };
+
+  /// Duty cycled averaged power spectrum, see HackRF_Spectrum.cpp
+  struct SpectrumMonitor {
+    SpectrumMonitor()
+        : active(false),
+          owns_rx(false),
+          size(1024),
+          averages(8),
+          rate(4.0),
+          capturing(false),
+          captured(0),
+          next_ns(0),
+          capture_ns(0),
+          ready(false),
+          stop(false),
+          bins_ns(0),
+          updates(0) {}
+
+    std::atomic<bool> active;
+    bool owns_rx;
+
+    // options and capture state, guarded by _spectrum_mutex
+    size_t size;
+    size_t averages;
+    double rate;
+
+    std::vector<int8_t> capture;
+    bool capturing;
+    size_t captured;
+    long long next_ns;
+    long long capture_ns;
+    bool ready;
+
+    bool stop;
+    std::thread worker;
+    std::condition_variable cond;
+
+    // latest result, also guarded by _spectrum_mutex
+    std::vector<float> bins;
+    long long bins_ns;
+    uint64_t updates;
+
+    // owned by the worker thread
+    std::vector<int8_t> frames;
+    std::vector<float> work;
+    HackRF_PowerSpectrum spectrum;
+  };
+
+  /// Preamble detection feeding the RX ring, see HackRF_Preamble.cpp
+  struct PreambleDetector {
+    PreambleDetector()
+        : active(false),
+          reference_changed(false),
+          threshold(0.5f),
+          pre(1024),
+          post(16384),
+          head(0),
+          count(0),
+          stop(false),
+          detections(0),
+          dropped(0),
+          raw_start(0),
+          scored(0),
+          in_run(false),
+          run_max(0.0f),
+          run_peak(0),
+          holdoff(0) {}
+
+    std::atomic<bool> active;
+
+    // options, guarded by _preamble_mutex
+    std::vector<float> reference;
+    bool reference_changed;
+    float threshold;
+    size_t pre;
+    size_t post;
+
+    // transfers handed over by the RX callback, guarded by _preamble_mutex
+    std::vector<std::vector<int8_t> > pool;
+    std::vector<uint64_t> pool_index;
+    uint32_t head;
+    uint32_t count;
+    bool stop;
+    std::thread worker;
+    std::condition_variable cond;
+    uint64_t detections;
+    uint64_t dropped;
+
+    // owned by the worker: samples from raw_start, scored up to scored
+    HackRF_Correlator correlator;
+    std::vector<int8_t> raw;
+    std::vector<float> conv;
+    std::vector<float> scores;
+    uint64_t raw_start;
+    uint64_t scored;
+    std::deque<uint64_t> peaks;
+    bool in_run;
+    float run_max;
+    uint64_t run_peak;
+    uint64_t holdoff;
   };
 
   RXStream _rx_stream;
   TXStream _tx_stream;
+  HackRF_Seqlock<ConfigSnapshot> _rx_config;
+  HackRF_Seqlock<ConfigSnapshot> _tx_config;
+  StreamWorker _rx_worker;
+  StreamWorker _tx_worker;
+  mutable StreamNotifier _rx_notify;
+  mutable StreamNotifier _tx_notify;
+  WaveformStore _waveforms;
+  Relay _relay;
+  Recorder _recorder;
+  Playback _playback;
+  SpectrumMonitor _spectrum;
+  PreambleDetector _preamble;
+  mutable ControlQueue _rx_control;
+  mutable ControlQueue _tx_control;
+  std::atomic<uint64_t> _control_issued;
+  std::atomic<uint64_t> _control_errors;
+
+  size_t _rx_num_channels;
 
   bool _rx_auto_bandwidth;
   bool _tx_auto_bandwidth;
@@ -336,8 +1122,28 @@ class SoapyHackRFDuplex : public SoapySDR::Device {
   /// close and re-open the device, so all use of _dev must be protected
   mutable std::mutex _tx_device_mutex;
   mutable std::mutex _rx_device_mutex;
-  std::mutex _rx_buf_mutex;
-  std::mutex _tx_buf_mutex;
+  /// Guards the RX channelizer configuration. Never held while taking
+  /// _rx_device_mutex, so setters may take it under the device mutex.
+  mutable std::mutex _rx_dsp_mutex;
+  /// Guards the TX DUC configuration, same lock ordering as _rx_dsp_mutex
+  mutable std::mutex _tx_dsp_mutex;
+  /// Guards the relay settings, taken in the RX callback before _tx_buf_mutex
+  mutable std::mutex _relay_mutex;
+  /// Guards the recorder pool, taken in the RX callback
+  mutable std::mutex _record_mutex;
+  /// Guards the playback mapping, taken in the TX callback
+  mutable std::mutex _playback_mutex;
+  /// Guards the waveform store, taken in the TX callback
+  mutable std::mutex _waveform_mutex;
+  /// Guards the spectrum monitor capture and bins, taken in the RX callback
+  mutable std::mutex _spectrum_mutex;
+  /// Guards the preamble detector options and pool, taken in the RX callback
+  mutable std::mutex _preamble_mutex;
+  /// Guards callback registration and the worker thread objects, taken
+  /// after the device mutexes and never held while joining a worker
+  mutable std::mutex _worker_mutex;
+  mutable std::mutex _rx_buf_mutex;
+  mutable std::mutex _tx_buf_mutex;
   std::condition_variable _rx_buf_cond;
   std::condition_variable _tx_buf_cond;
 
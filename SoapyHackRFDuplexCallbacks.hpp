@@ -0,0 +1,79 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2026 Tom Cully
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+/*
+ * Push model streaming for the HackRFDuplex driver. Register a callback with
+ *
+ *   device->writeSetting("rx_callback",
+ *                        SoapyHackRFDuplex_callbackArg(on_rx, user));
+ *
+ * and remove it again by writing an empty value. While a callback is
+ * registered the driver runs its own worker thread for that stream whenever
+ * the stream is active, so the application must not call readStream() or
+ * writeStream() on it as well. Callbacks must return promptly and must not
+ * close the stream they serve.
+ */
+
+/*!
+ * Called with each RX buffer in the stream format, one pointer per stream
+ * channel. ret is the sample count, or a SoapySDR error code such as
+ * SOAPY_SDR_OVERFLOW with flags and timeNs as readStream() would return
+ * them. buffs point into driver memory and are only valid during the call.
+ */
+typedef void (*SoapyHackRFDuplexRXCallback)(void *user,
+                                            const void *const *buffs, int ret,
+                                            int flags, long long timeNs);
+
+/*!
+ * Called whenever the TX ring has room. Write at most numElems samples in
+ * the stream format into buffs and return how many were written, setting
+ * SOAPY_SDR_END_BURST in flags to end a burst. A short buffer is padded with
+ * zeros, so returning 0 keeps the board fed. A negative return stops the
+ * worker.
+ */
+typedef int (*SoapyHackRFDuplexTXCallback)(void *user, void *const *buffs,
+                                           size_t numElems, int &flags);
+
+/// Setting value registering fn with the user pointer passed back to it
+inline std::string SoapyHackRFDuplex_callbackArg(
+    SoapyHackRFDuplexRXCallback fn, void *user) {
+  char arg[64];
+  snprintf(arg, sizeof(arg), "%llx:%llx",
+           (unsigned long long)reinterpret_cast<uintptr_t>(fn),
+           (unsigned long long)reinterpret_cast<uintptr_t>(user));
+  return arg;
+}
+
+inline std::string SoapyHackRFDuplex_callbackArg(
+    SoapyHackRFDuplexTXCallback fn, void *user) {
+  char arg[64];
+  snprintf(arg, sizeof(arg), "%llx:%llx",
+           (unsigned long long)reinterpret_cast<uintptr_t>(fn),
+           (unsigned long long)reinterpret_cast<uintptr_t>(user));
+  return arg;
+}